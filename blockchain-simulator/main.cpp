@@ -12,18 +12,99 @@
 // The menu was tested in Windows Command Prompt
 //
 // Note: Inside the menu, the slow printing can be skipped by pressing enter. The exe can also be ran with --fast parameter.
+// The simulator can also run a scenario file without the menu: --headless scenario.txt [--out summary.json]
+// (the format of the scenario is described in the HEADLESS DRIVER section)
+// the scenarios folder has scenarios which assert on their result (the run exits with 1 if an assertion is not met)
+// --bench [quick] runs the microbenchmarks of the hot paths
+// (allocations per operation are only counted in a build with -DCOUNT_ALLOCATIONS, the hook slows down every allocation)
 
 #include <iostream>
 #include <cstring>
 #include <sstream>
 #include <list>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <climits>
+#include <queue>
 #include <cmath>
 #include <unordered_map>
+#include <unordered_set>
 #include <chrono>
 #include <thread>
-#include <conio.h>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <new>
 #include <variant>
 #include <iomanip>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+// the block log is read through a memory mapping, the headless mode reports the peak memory
+// the menu reads single key presses (conio on Windows, a termios replacement elsewhere)
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+    #include <conio.h>
+    #define CLEAR_COMMAND "cls"
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/resource.h>
+    #include <sys/select.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <termios.h>
+    #define CLEAR_COMMAND "clear"
+
+    int _getch(){
+        // reads a key without waiting for enter and without echoing it
+        termios old, raw;
+        if (tcgetattr(STDIN_FILENO, &old) != 0)
+            return getchar();   // not a terminal (e.g. input from a pipe)
+        raw = old;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        int c = getchar();
+        tcsetattr(STDIN_FILENO, TCSANOW, &old);
+        return c == '\n' ? '\r' : c;      // conio reports enter as carriage return
+    }
+
+    int _kbhit(){
+        // only key presses count, input coming from a pipe is left for _getch
+        if (!isatty(STDIN_FILENO))
+            return 0;
+        termios old, raw;
+        tcgetattr(STDIN_FILENO, &old);
+        raw = old;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        fd_set keys;
+        FD_ZERO(&keys);
+        FD_SET(STDIN_FILENO, &keys);
+        timeval now = {0, 0};
+        int ready = select(STDIN_FILENO + 1, &keys, NULL, NULL, &now);
+        tcsetattr(STDIN_FILENO, TCSANOW, &old);
+        return ready > 0;
+    }
+#endif
+
+// the hash kernel has an AVX2 path which is picked at runtime (x86 only)
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define HASH_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define TARGET_AVX2
+    #else
+        #define TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
 
 // define colours for the console
 #define ANSI_COLOR_GREEN   "\x1b[32m"
@@ -33,6 +114,36 @@
 #define ANSI_COLOR_RESET   "\x1b[0m"
 
 using namespace std;
+
+#ifdef COUNT_ALLOCATIONS
+// every allocation made with new is counted (the benchmarks report allocations per operation)
+// only in the benchmark build: the shared counter would slow down every allocation of the other modes
+atomic<long long> allocationCount(0);
+
+// kept out of line: once inlined gcc sees malloc/free behind new/delete and reports them as mismatched
+    #ifdef __GNUC__
+        #define NO_INLINE __attribute__((noinline))
+    #else
+        #define NO_INLINE
+    #endif
+
+NO_INLINE void* operator new(size_t size){
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+NO_INLINE void operator delete(void *p) noexcept{
+    free(p);
+}
+
+NO_INLINE void operator delete(void *p, size_t) noexcept{
+    free(p);
+}
+#endif
+
 class Block;
 
 // some utility functions useful at different points in the code
@@ -72,50 +183,488 @@ bool isAddress(string addr){
 string generateRandomHex(){
     // generates a random address (a random hex string)
     // since it has length 40, we can consider it an address too
-    stringstream ss;
-    ss << "0x";
-    for (int i = 0; i < 40; i++)
-        ss << hex << rand() % 16;
-    return ss.str();
+    static const char digits[] = "0123456789abcdef";
+    char buffer[42] = {'0', 'x'};
+    for (int i = 2; i < 42; i++)
+        buffer[i] = digits[rand() % 16];
+    return string(buffer, 42);
 }
 
 // functions for different categories of console messages
+// in quiet mode (headless runs) the messages are only counted, so the console stays off the hot path
+
+bool quietMessages = false;
+atomic<long long> suppressedMessages(0);     // messages can come from the block worker as well
 
 void info(string msg){
+    if (quietMessages){
+        suppressedMessages++;
+        return;
+    }
     cout << ANSI_COLOR_CYAN << "INFO: " << ANSI_COLOR_RESET << msg << endl;
 }
 
 void warning(string msg){
+    if (quietMessages){
+        suppressedMessages++;
+        return;
+    }
     cout << ANSI_COLOR_YELLOW << "WARNING: " << ANSI_COLOR_RESET << msg << endl;
 }
 
 void sysMessage(string msg){
+    if (quietMessages){
+        suppressedMessages++;
+        return;
+    }
     cout << ANSI_COLOR_RED << "SYS: " << ANSI_COLOR_RESET << msg << endl;
 }
 
+// ----------------- ADDRESS -----------------
+
+class Address{
+    // binary form of an address (20 bytes instead of a 42 character hex string)
+    // hex is only parsed and printed at the I/O boundary, comparisons and hashing work on the raw bytes
+    unsigned char bytes[20];
+
+    public:
+        // CONSTRUCTORS
+        Address();
+        explicit Address(string hex);
+        explicit Address(const unsigned char *bytes);
+
+        // utility functions
+        string toHex() const;
+        size_t hashValue() const;
+
+        // OPERATORS
+        bool operator==(const Address&) const;
+        bool operator!=(const Address&) const;
+        bool operator<(const Address&) const;
+
+        // GETTERS
+        const unsigned char* getBytes() const;
+};
+
+// CONSTRUCTORS
+Address::Address(){
+    memset(this -> bytes, 0, sizeof(this -> bytes));
+}
+
+Address::Address(string hex){
+    // parses a "0x" prefixed address, anything that is not an address becomes the zero address
+    memset(this -> bytes, 0, sizeof(this -> bytes));
+    if (!isAddress(hex))
+        return;
+
+    auto nibble = [](char c){
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return c - 'A' + 10;
+    };
+    for (int i = 0; i < 20; i++)
+        this -> bytes[i] = (nibble(hex[2 + 2 * i]) << 4) | nibble(hex[3 + 2 * i]);
+}
+
+Address::Address(const unsigned char *bytes){
+    // copies 20 raw bytes (e.g. read from a file)
+    memcpy(this -> bytes, bytes, sizeof(this -> bytes));
+}
+
+// GETTERS
+const unsigned char* Address::getBytes() const{
+    return this -> bytes;
+}
+
+// OPERATORS
+bool Address::operator==(const Address &obj) const{
+    return memcmp(this -> bytes, obj.bytes, sizeof(this -> bytes)) == 0;
+}
+
+bool Address::operator!=(const Address &obj) const{
+    return !(*this == obj);
+}
+
+bool Address::operator<(const Address &obj) const{
+    return memcmp(this -> bytes, obj.bytes, sizeof(this -> bytes)) < 0;
+}
+
+ostream& operator<<(ostream &out, const Address &obj){
+    out << obj.toHex();
+    return out;
+}
+
+// utility functions
+string Address::toHex() const{
+    static const char digits[] = "0123456789abcdef";
+    string hex(42, '0');
+    hex[1] = 'x';
+    for (int i = 0; i < 20; i++){
+        hex[2 + 2 * i] = digits[this -> bytes[i] >> 4];
+        hex[3 + 2 * i] = digits[this -> bytes[i] & 15];
+    }
+    return hex;
+}
+
+size_t Address::hashValue() const{
+    // addresses are already random looking, so mixing the first 16 bytes is enough
+    unsigned long long a, b;
+    memcpy(&a, this -> bytes, 8);
+    memcpy(&b, this -> bytes + 8, 8);
+    unsigned long long h = a ^ (b * 0x9e3779b97f4a7c15);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    return h;
+}
+
+// allows using addresses as keys in unordered containers
+namespace std{
+    template<> struct hash<Address>{
+        size_t operator()(const Address &addr) const{
+            return addr.hashValue();
+        }
+    };
+}
+
+// ----------------- HASH -----------------
+
+class Hash{
+    // binary form of a transaction hash (the hash function produces 64 bits, so 8 bytes)
+    // like addresses, it is only converted to a hex string for printing
+    unsigned long long value;   // 0 means the hash was not set
+
+    public:
+        // CONSTRUCTORS
+        Hash();
+        explicit Hash(unsigned long long value);
+        explicit Hash(string hex);
+
+        // utility functions
+        string toHex() const;
+        int writeHex(char *out) const;
+        bool isSet() const;
+
+        // OPERATORS
+        bool operator==(const Hash&) const;
+        bool operator!=(const Hash&) const;
+        bool operator<(const Hash&) const;
+
+        // GETTERS
+        unsigned long long getValue() const;
+};
+
+// CONSTRUCTORS
+Hash::Hash():value(0) {}
+
+Hash::Hash(unsigned long long value):value(value) {}
+
+Hash::Hash(string hex):value(0){
+    // parses a "0x" prefixed hex string of at most 16 digits, anything else leaves the hash unset
+    if (hex.length() < 3 || hex.length() > 18 || hex.substr(0, 2) != "0x" || !isProperHex(hex.substr(2)))
+        return;
+    this -> value = stoull(hex.substr(2), NULL, 16);
+}
+
+// GETTERS
+unsigned long long Hash::getValue() const{
+    return this -> value;
+}
+
+// OPERATORS
+bool Hash::operator==(const Hash &obj) const{
+    return this -> value == obj.value;
+}
+
+bool Hash::operator!=(const Hash &obj) const{
+    return this -> value != obj.value;
+}
+
+bool Hash::operator<(const Hash &obj) const{
+    return this -> value < obj.value;
+}
+
+ostream& operator<<(ostream &out, const Hash &obj){
+    out << obj.toHex();
+    return out;
+}
+
+// utility functions
+bool Hash::isSet() const{
+    return this -> value != 0;
+}
+
+int Hash::writeHex(char *out) const{
+    // writes the hex form ("0x" prefix, no leading zeros) in a buffer of at least 19 characters
+    // returns the number of characters written (0 if the hash is not set)
+    if (!this -> isSet()){
+        out[0] = 0;
+        return 0;
+    }
+    return snprintf(out, 19, "0x%llx", this -> value);
+}
+
+string Hash::toHex() const{
+    char buffer[19];
+    this -> writeHex(buffer);
+    return buffer;
+}
+
+namespace std{
+    template<> struct hash<Hash>{
+        size_t operator()(const Hash &h) const{
+            return h.getValue();    // the value is already a hash
+        }
+    };
+}
+
+// ----------------- HASHER -----------------
+
+// versions of the hash function, hashes produced by different versions are not compatible
+// v1 is the original algorithm: every input word (every character of an address or hash) goes through hashFunc
+// v2 consumes the input in 32 byte stripes (4 lanes of 8 bytes) and has a scalar and an AVX2 implementation
+const int HASH_V1 = 1;
+const int HASH_V2 = 2;
+
+class Hasher{
+    // streaming hasher (init / update / final) used for transaction and block hashes
+    // the output only depends on the version and the input, never on the implementation that was picked
+    static int defaultVersion;
+    static const unsigned long long secret[4];
+
+    int version;
+    unsigned long long state;           // v1 state
+    unsigned long long lanes[4];        // v2 accumulators
+    unsigned char buffer[32];           // v2 input that does not fill a stripe yet
+    int buffered;
+    unsigned long long length;          // v2 total number of bytes
+
+    static void stripesScalar(unsigned long long *lanes, const unsigned char *data, size_t stripes);
+#ifdef HASH_X86
+    TARGET_AVX2 static void stripesAvx2(unsigned long long *lanes, const unsigned char *data, size_t stripes);
+#endif
+    static void (*selectStripes())(unsigned long long*, const unsigned char*, size_t);
+
+    public:
+        // CONSTRUCTORS
+        Hasher();
+        Hasher(int version);
+
+        // utility functions
+        void init(int version);
+        void update(const void *data, size_t size);
+        void updateWord(long long word);
+        unsigned long long final();
+        static bool hasAvx2();
+
+        // GETTERS
+        int getVersion() const;
+        static int getDefaultVersion();
+
+        // SETTERS
+        static void setDefaultVersion(int);
+};
+
+int Hasher::defaultVersion = HASH_V2;
+const unsigned long long Hasher::secret[4] = {0x9e3779b97f4a7c15, 0xc2b2ae3d27d4eb4f, 0x165667b19e3779f9, 0x85ebca77c2b2ae63};
+
+// CONSTRUCTORS
+Hasher::Hasher(){
+    this -> init(defaultVersion);
+}
+
+Hasher::Hasher(int version){
+    this -> init(version);
+}
+
+// GETTERS
+int Hasher::getVersion() const{
+    return this -> version;
+}
+
+int Hasher::getDefaultVersion(){
+    return defaultVersion;
+}
+
+// SETTERS
+void Hasher::setDefaultVersion(int version){
+    // should be set before any transaction is created, older hashes would no longer match
+    if (version != HASH_V1 && version != HASH_V2){
+        sysMessage("Unknown hash version. The default hash version was not modified.");
+        return;
+    }
+    defaultVersion = version;
+}
+
+// utility functions
+void Hasher::init(int version){
+    if (version != HASH_V1 && version != HASH_V2){
+        sysMessage("Unknown hash version. The default version was used.");
+        version = defaultVersion;
+    }
+    this -> version = version;
+    this -> state = 0;
+    for (int i = 0; i < 4; i++)
+        this -> lanes[i] = secret[i];
+    this -> buffered = 0;
+    this -> length = 0;
+}
+
+void Hasher::stripesScalar(unsigned long long *lanes, const unsigned char *data, size_t stripes){
+    for (size_t s = 0; s < stripes; s++, data += 32){
+        for (int i = 0; i < 4; i++){
+            // little endian load, so the result is the same on every platform
+            unsigned long long word = 0;
+            for (int b = 7; b >= 0; b--)
+                word = (word << 8) | data[8 * i + b];
+
+            unsigned long long keyed = word ^ secret[i];
+            lanes[i] = (lanes[i] << 23) | (lanes[i] >> 41);
+            lanes[i] += (keyed & 0xffffffff) * (keyed >> 32);
+            lanes[i] += word;
+        }
+    }
+}
+
+#ifdef HASH_X86
+TARGET_AVX2 void Hasher::stripesAvx2(unsigned long long *lanes, const unsigned char *data, size_t stripes){
+    // same steps as stripesScalar, the 4 lanes are processed at once
+    __m256i acc = _mm256_loadu_si256((const __m256i*)lanes);
+    __m256i key = _mm256_loadu_si256((const __m256i*)secret);
+    for (size_t s = 0; s < stripes; s++, data += 32){
+        __m256i word = _mm256_loadu_si256((const __m256i*)data);
+        __m256i keyed = _mm256_xor_si256(word, key);
+        __m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+        acc = _mm256_or_si256(_mm256_slli_epi64(acc, 23), _mm256_srli_epi64(acc, 41));
+        acc = _mm256_add_epi64(acc, product);
+        acc = _mm256_add_epi64(acc, word);
+    }
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+}
+#endif
+
+bool Hasher::hasAvx2(){
+#if defined(HASH_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 6) != 6)      // the OS needs to save the AVX registers
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(HASH_X86)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+void (*Hasher::selectStripes())(unsigned long long*, const unsigned char*, size_t){
+#ifdef HASH_X86
+    if (hasAvx2())
+        return stripesAvx2;
+#endif
+    return stripesScalar;
+}
+
+void Hasher::update(const void *data, size_t size){
+    const unsigned char *bytes = (const unsigned char*)data;
+    if (this -> version == HASH_V1){
+        // every byte is a separate word (like the characters of a string)
+        for (size_t i = 0; i < size; i++)
+            hashFunc(this -> state, int(bytes[i]));
+        return;
+    }
+
+    // the implementation is picked once, on the first use
+    static void (*stripes)(unsigned long long*, const unsigned char*, size_t) = selectStripes();
+
+    this -> length += size;
+    if (this -> buffered > 0){
+        size_t take = min(size, size_t(32 - this -> buffered));
+        memcpy(this -> buffer + this -> buffered, bytes, take);
+        this -> buffered += take;
+        bytes += take;
+        size -= take;
+        if (this -> buffered < 32)
+            return;
+        stripes(this -> lanes, this -> buffer, 1);
+        this -> buffered = 0;
+    }
+    if (size >= 32){
+        stripes(this -> lanes, bytes, size / 32);
+        bytes += size - size % 32;
+        size %= 32;
+    }
+    memcpy(this -> buffer, bytes, size);
+    this -> buffered = size;
+}
+
+void Hasher::updateWord(long long word){
+    if (this -> version == HASH_V1){
+        hashFunc(this -> state, long(word));
+        return;
+    }
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++)
+        bytes[i] = (unsigned long long)word >> (8 * i);
+    this -> update(bytes, 8);
+}
+
+unsigned long long Hasher::final(){
+    if (this -> version == HASH_V1)
+        return this -> state;
+
+    // the last partial stripe is padded with zeros (the length is mixed in, so padding can't collide)
+    if (this -> buffered > 0){
+        memset(this -> buffer + this -> buffered, 0, 32 - this -> buffered);
+        stripesScalar(this -> lanes, this -> buffer, 1);
+        this -> buffered = 0;
+    }
+
+    auto mix = [](unsigned long long h){
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccd;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53;
+        h ^= h >> 33;
+        return h;
+    };
+    unsigned long long h = this -> length * secret[0];
+    for (int i = 0; i < 4; i++)
+        h = (h ^ mix(this -> lanes[i])) * 0x9e3779b97f4a7c15 + secret[i];
+    return mix(h);
+}
+
 // ----------------- TRANSACTION -----------------
 
 class Transaction{
-    string hash;        // hash of the other fields (id of transaction)
-    string from, to;
+    Hash hash;          // hash of the other fields (id of transaction)
+    Address from, to;
     int amount, fee;    // !!! amount and fee are expressed as 1/100 of a unit of coin (amount = 102 <=> user has 1.02 coins)
                         // in some places they are represented as floats for UX but are stored as integers
     int nonce;          // nonce of the transaction (used to prevent double spending)
     bool isMined;       // under normal circumstances only the blockchain changes this value to true
-    static const string godAddress;  // special address
+    bool validFrom, validTo;         // false if the addresses were never set (or were set from invalid strings)
+    bool hashDirty;     // true if a hashed field changed since the last updateHash (the hash might not match the fields)
+    static const Address godAddress; // special address
 
     public:
         // CONSTRUCTORS
         Transaction();
-        Transaction(string from, string to, int);
-        Transaction(string from, string to, int amount, int nonce, int fee);
-        Transaction(string from, string to, int amount, int fee, int nonce, bool isMined);
-        Transaction(string hash, string from, string to, int amount, int fee, int nonce, bool isMined);
+        Transaction(const Address &from, const Address &to, int);
+        Transaction(const Address &from, const Address &to, int amount, int nonce, int fee);
+        Transaction(const Address &from, const Address &to, int amount, int fee, int nonce, bool isMined);
+        Transaction(const Hash &hash, const Address &from, const Address &to, int amount, int fee, int nonce, bool isMined);
         Transaction(const Transaction&);
 
         // utility functions
-        string calculateHash() const;
+        Hash calculateHash() const;
         void updateHash();
+        bool isHashDirty() const;
         bool isMineable() const;
 
         // OPERATORS
@@ -133,18 +682,20 @@ class Transaction{
         operator int() const;
 
         // GETTERS
-        string getHash() const;
-        string getFrom() const;
-        string getTo() const;
+        const Hash& getHash() const;
+        const Address& getFrom() const;
+        const Address& getTo() const;
         long getAmount() const;
         long getFee() const;
         int getNonce() const;
         bool getIsMined() const;
-        static const string getGodAddress();
+        static const Address& getGodAddress();
 
         //SETTERS
         void setFrom(string from);
+        void setFrom(const Address &from);
         void setTo(string to);
+        void setTo(const Address &to);
         void setAmount(int amount);
         void setFee(int fee);
         void setNonce(int nonce);
@@ -154,18 +705,18 @@ class Transaction{
         ~Transaction();
 };
 
-const string Transaction::godAddress = "0x0000000000000000000000000000000000000000";
+const Address Transaction::godAddress;  // the zero address
 
 // CONSTRUCTORS
-Transaction::Transaction():from(""), to(""), amount(0), fee(0), nonce(0), hash(""), isMined(false) {}
+Transaction::Transaction():amount(0), fee(0), nonce(0), isMined(false), validFrom(false), validTo(false), hashDirty(true) {}
 
-Transaction::Transaction(string from, string to, int amount):fee(0), nonce(0), hash(""), isMined(false){
+Transaction::Transaction(const Address &from, const Address &to, int amount):fee(0), nonce(0), isMined(false), hashDirty(true){
     this -> setFrom(from);
     this -> setTo(to);
     this -> setAmount(amount);
 }
 
-Transaction::Transaction(string from, string to, int amount, int nonce, int fee = 100):isMined(false){
+Transaction::Transaction(const Address &from, const Address &to, int amount, int nonce, int fee = 100):isMined(false){
     this -> setFrom(from);
     this -> setTo(to);
     this -> setAmount(amount);
@@ -174,7 +725,7 @@ Transaction::Transaction(string from, string to, int amount, int nonce, int fee
     this -> updateHash();
 }
 
-Transaction::Transaction(string from, string to, int amount, int fee, int nonce, bool isMined){
+Transaction::Transaction(const Address &from, const Address &to, int amount, int fee, int nonce, bool isMined){
     this -> setFrom(from);
     this -> setTo(to);
     this -> setAmount(amount);
@@ -182,10 +733,10 @@ Transaction::Transaction(string from, string to, int amount, int fee, int nonce,
     this -> setNonce(nonce);
     this -> isMined = isMined;
     
-    this -> hash = this -> calculateHash();
+    this -> updateHash();
 }
 
-Transaction::Transaction(string hash, string from, string to, int amount, int fee, int nonce, bool isMined){
+Transaction::Transaction(const Hash &hash, const Address &from, const Address &to, int amount, int fee, int nonce, bool isMined){
     this -> setFrom(from);
     this -> setTo(to);
     this -> setAmount(amount);
@@ -193,28 +744,31 @@ Transaction::Transaction(string hash, string from, string to, int amount, int fe
     this -> setNonce(nonce);
     this -> isMined = isMined;
 
-    if (hash != "0x" + this -> calculateHash()){
+    if (hash != this -> calculateHash()){
         sysMessage("The hash provided does not match the hash calculated from the other fields. The hash was not set.");
-        this -> hash = "";
+        this -> hash = Hash();
+        return;
     }
-    else this -> updateHash();
+    this -> hash = hash;
+    this -> hashDirty = false;
 }
 
-Transaction::Transaction(const Transaction &obj):from(obj.from), to(obj.to), amount(obj.amount), 
-                                                 fee(obj.fee), nonce(obj.nonce), isMined(obj.isMined){
-    this -> hash = this -> calculateHash();
+Transaction::Transaction(const Transaction &obj):hash(obj.hash), from(obj.from), to(obj.to), amount(obj.amount), 
+                                                 fee(obj.fee), nonce(obj.nonce), isMined(obj.isMined),
+                                                 validFrom(obj.validFrom), validTo(obj.validTo), hashDirty(obj.hashDirty){
+    // the hash is copied together with its state, a clean hash still matches the copied fields
 }
 
 // GETTERS
-string Transaction::getHash() const{
+const Hash& Transaction::getHash() const{
     return this -> hash;
 }
 
-string Transaction::getFrom() const{
+const Address& Transaction::getFrom() const{
     return this -> from;
 }
 
-string Transaction::getTo() const{
+const Address& Transaction::getTo() const{
     return this -> to;
 }
 
@@ -234,7 +788,7 @@ bool Transaction::getIsMined() const{
     return this -> isMined;
 }
 
-const string Transaction::getGodAddress(){
+const Address& Transaction::getGodAddress(){
     return godAddress;
 }
 
@@ -242,46 +796,68 @@ const string Transaction::getGodAddress(){
 void Transaction::setFrom(string from){
     if (!isAddress(from)){
         sysMessage("The string is not an address.");
-        this -> from = "";
+        this -> from = Address();
+        this -> validFrom = false;
+        this -> hashDirty = true;
         return;
     }
+    this -> setFrom(Address(from));
+}
+
+void Transaction::setFrom(const Address &from){
     this -> from = from;
+    this -> validFrom = true;
+    this -> hashDirty = true;
 }
 
 void Transaction::setTo(string to){
     if (!isAddress(to)){
         sysMessage("The string is not an address.");
-        this -> from = "";
+        this -> to = Address();
+        this -> validTo = false;
+        this -> hashDirty = true;
         return;
     }
+    this -> setTo(Address(to));
+}
+
+void Transaction::setTo(const Address &to){
     this -> to = to;
+    this -> validTo = true;
+    this -> hashDirty = true;
 }
 
 void Transaction::setAmount(int amount){
     if (amount < 0){
         sysMessage("Amount can not be negative. Zero has been filled by default.");
         this -> amount = 0;
+        this -> hashDirty = true;
         return;
     }
     this -> amount = amount;
+    this -> hashDirty = true;
 }
 
 void Transaction::setFee(int fee){
     if (fee <= 0){
         sysMessage("Fee needs to be greater than 0. The default was set (1 coin)");
         this -> fee = 100;
+        this -> hashDirty = true;
         return;
     }
     this -> fee = fee;
+    this -> hashDirty = true;
 }
 
 void Transaction::setNonce(int nonce){
     if (nonce < 0){
         sysMessage("Nonce needs to be greater than 0.");
         this -> nonce = 0;
+        this -> hashDirty = true;
         return;
     }
     this -> nonce = nonce;
+    this -> hashDirty = true;
 }
 
 void Transaction::setIsMined(bool isMined){
@@ -296,7 +872,6 @@ Transaction::~Transaction(){
 // OPERATORS
 istream& operator>>(istream& in, Transaction &obj){
     // we will use the setters to read into variables (since they perform checks on the input data)
-    string hash;
     string from, to;
     double amount;
     string fee, nonce;
@@ -337,10 +912,10 @@ istream& operator>>(istream& in, Transaction &obj){
 
     // set the fields of the transaction
     if (from == "god")
-        from = Transaction::getGodAddress();
+        from = Transaction::getGodAddress().toHex();
     obj.setFrom(from);
     if (to == "god")
-        to = Transaction::getGodAddress();
+        to = Transaction::getGodAddress().toHex();
     obj.setTo(to);
     obj.setAmount(int(amount * 100));
     obj.setIsMined(false);
@@ -367,12 +942,15 @@ Transaction& Transaction::operator=(const Transaction &obj){
 
     this -> from = obj.from;
     this -> to = obj.to;
+    this -> validFrom = obj.validFrom;
+    this -> validTo = obj.validTo;
     this -> amount = obj.amount;
     this -> fee = obj.fee;
     this -> nonce = obj.nonce;
     this -> isMined = obj.isMined;
 
-    this -> hash = this -> calculateHash();
+    this -> hash = obj.hash;
+    this -> hashDirty = obj.hashDirty;
     return *this;
 }
 
@@ -386,11 +964,11 @@ variant<string, int, bool> Transaction::operator[](int index){
     // it's not the best way to do it, but it's a proof of concept
     switch (index){
         case 0:
-            return this -> hash;
+            return this -> hash.toHex();
         case 1:
-            return this -> from;
+            return this -> from.toHex();
         case 2:
-            return this -> to;
+            return this -> to.toHex();
         case 3:
             return this -> amount;
         case 4:
@@ -406,7 +984,7 @@ variant<string, int, bool> Transaction::operator[](int index){
 
 Transaction& Transaction::operator++(){
     // increment the nonce of the transaction
-    this -> nonce++;
+    this -> setNonce(this -> nonce + 1);
     this -> updateHash();
     return *this;
 }
@@ -444,6 +1022,7 @@ Transaction operator-(float amount, const Transaction &tx){
     // subtracts an integer amount of coins from the transaction
     Transaction copy = tx;
     copy.setAmount(int(amount * 100) - copy.getAmount());
+    copy.updateHash();
     return copy;
 }
 
@@ -462,11 +1041,11 @@ bool Transaction::operator==(const Transaction &obj){
 }
 
 Transaction::operator string(){
-    return this -> hash;
+    return this -> hash.toHex();
 }
 
 Transaction::operator string() const{
-    return this -> hash;
+    return this -> hash.toHex();
 }
 
 Transaction::operator int() const{
@@ -474,32 +1053,56 @@ Transaction::operator int() const{
 }
 
 // utility functions
-string Transaction::calculateHash() const{
+Hash Transaction::calculateHash() const{
     // calculates a hash based on all fields of the transaction (except the isMined field)
-    // maybe hashVal should start from some special value for cryptographic reasons
+    // maybe the hash should start from some special value for cryptographic reasons
     // but it's good enough for a proof of concept
-    unsigned long long hashVal = 0;
-    for (int i = 0; i < this -> from.length(); i++){
-        hashFunc(hashVal, int(from[i]));           // length can't differ from 42 (address length)
-        hashFunc(hashVal, int(to[i]));
+    Hasher hasher;
+    if (hasher.getVersion() == HASH_V1){
+        // the addresses are hashed in their hex form (which is generated on the fly, without building strings)
+        static const char digits[] = "0123456789abcdef";
+        auto hexChar = [](const Address &addr, int i){
+            if (i < 2)
+                return int("0x"[i]);
+            unsigned char byte = addr.getBytes()[(i - 2) / 2];
+            return int(digits[i % 2 == 0 ? byte >> 4 : byte & 15]);
+        };
+        if (this -> validFrom)
+            for (int i = 0; i < 42; i++){
+                hasher.updateWord(hexChar(from, i));    // length can't differ from 42 (address length)
+                hasher.updateWord(hexChar(to, i));
+            }
+        hasher.updateWord(amount);
+        hasher.updateWord(int(fee));
+        hasher.updateWord(int(nonce));
+        return Hash(hasher.final());
     }
-    hashFunc(hashVal, amount);
-    hashFunc(hashVal, int(fee));
-    hashFunc(hashVal, int(nonce));
 
-    stringstream ss;
-    ss << hex << hashVal;
-    return "0x" + ss.str();
+    // the fields are packed in a single record and hashed at once
+    unsigned char record[52];
+    memcpy(record, this -> from.getBytes(), 20);
+    memcpy(record + 20, this -> to.getBytes(), 20);
+    int fields[3] = {this -> amount, this -> fee, this -> nonce};
+    for (int i = 0; i < 3; i++)
+        for (int b = 0; b < 4; b++)
+            record[40 + 4 * i + b] = (unsigned int)fields[i] >> (8 * b);
+    hasher.update(record, sizeof(record));
+    return Hash(hasher.final());
 }
 
 void Transaction::updateHash(){
     this -> hash = this -> calculateHash();
+    this -> hashDirty = false;
+}
+
+bool Transaction::isHashDirty() const{
+    return this -> hashDirty;
 }
 
 bool Transaction::isMineable() const{
     // check if a transaction can be included in a block
     // this is more of a syntax check, the blockchain needs to check balances and nonces itself!
-    if (!isAddress(this -> from) || !isAddress(this -> to))
+    if (!this -> validFrom || !this -> validTo)
         return false;
     if (this -> amount < 0)
         return false;
@@ -507,121 +1110,545 @@ bool Transaction::isMineable() const{
         return false;
     if (this -> nonce < 0)
         return false;
-    if (this -> hash != this -> calculateHash())
+    // a clean hash was calculated from the current fields, so it only has to be recalculated after a change
+    if (this -> hashDirty && this -> hash != this -> calculateHash())
         return false;
     return true;
 }
 
-// ----------------- MEMPOOL -----------------
+// ----------------- TRANSACTION POOL -----------------
 
-class Mempool{
-    // The mempool is a list of transactions that are waiting to be mined
+class TxPool{
+    // owns every transaction of the simulator exactly once
+    // the transactions live in fixed size chunks that never move, so a slot (and a pointer to its transaction) stays valid
+    // for as long as someone holds a handle to it; released slots are reused, so steady traffic does not allocate
+    // the mempool, blocks and wallets share transactions through TxRef handles instead of copying them around
+    public:
+        static const int chunkSize = 4096;      // slots per chunk
+        static const int maxChunks = 16384;     // upper bound of the pool (chunkSize * maxChunks slots)
 
-    list<Transaction> txList;   // list of transactions not yet included in a block
-    int maxSize;                // maximum number of transactions that can be stored in the mempool (DDoS securtity measure)
-    int minFee;                 // minimum fee for a transaction to be included in the mempool
-    float averageFee;           // average fee of transactions in the mempool
+    private:
+    struct Slot{
+        Transaction tx;
+        atomic<int> refs;   // number of handles pointing to the slot (0 if the slot is free)
+        int nextFree;       // next slot of the free list
+    };
+
+    Slot *chunks[maxChunks];    // the table never reallocates, so readers don't need the lock
+    int chunkCount;
+    int freeHead;               // first free slot (-1 if every allocated slot is in use)
+    int liveCount;              // slots currently in use
+    mutex lock;                 // guards the free list and the allocation of chunks
+
+    Slot& slot(int index) const;
 
     public:
         // CONSTRUCTORS
-        Mempool();
-        Mempool(list<Transaction> txList);
-        Mempool(list<Transaction> txList, int maxSize);
-        Mempool(list<Transaction> txList, int maxSize, int minFee);
-        Mempool(list<Transaction> txList, int maxSize, int minFee, float averageFee);
-        Mempool(const Mempool &obj);
+        TxPool();
+        TxPool(const TxPool&) = delete;
 
         // utility functions
-        void updateAverageFee();
-        void addTx(Transaction&);
-        void deleteTx(string);
+        static TxPool& global();
+        int create(const Transaction &tx);
+        void retain(int index);
+        void release(int index);
 
         // OPERATORS
-        Mempool& operator=(const Mempool&);
-        Transaction operator[](string);
-        Mempool& operator--();
-        Mempool operator--(int);
-        Mempool operator+(Mempool&);
-        Mempool operator-(Mempool&);
-        bool operator<(const Mempool &obj) const;
-        bool operator<=(const Mempool &obj) const;
-        bool operator>(const Mempool &obj);
-        bool operator>=(const Mempool &obj);
-        bool operator==(const Mempool &obj) const;
-        operator list<Transaction>() const;
+        TxPool& operator=(const TxPool&) = delete;
 
         // GETTERS
-        const list<Transaction>& getTxList() const;
-        int getMaxSize() const;
-        int getMinFee() const;
-        float getAverageFee() const;
-
-        // SETTERS
-        void setTxList(list<Transaction>);
-        void setMaxSize(int);
-        void setMinFee(int);
-        void setAverageFee(float);
+        const Transaction& get(int index) const;
+        int getLiveCount();
+        int getCapacity();
 
         // DESTRUCTOR
-        ~Mempool();
+        ~TxPool();
 };
 
 // CONSTRUCTORS
-Mempool::Mempool():maxSize(1024), minFee(25), averageFee(0) {} // txList is empty by default
+TxPool::TxPool():chunkCount(0), freeHead(-1), liveCount(0) {}
 
-Mempool::Mempool(list<Transaction> txList):maxSize(1024), minFee(25){
-    this -> setTxList(txList);
-    this -> updateAverageFee();
+// GETTERS
+const Transaction& TxPool::get(int index) const{
+    return this -> slot(index).tx;
 }
 
-Mempool::Mempool(list<Transaction> txList, int maxSize):minFee(25){
-    this -> setMaxSize(maxSize);
-    this -> setTxList(txList);
-    this -> updateAverageFee();
+int TxPool::getLiveCount(){
+    lock_guard<mutex> guard(this -> lock);
+    return this -> liveCount;
 }
 
-Mempool::Mempool(list<Transaction> txList, int maxSize, int minFee){
-    this -> setMaxSize(maxSize);
-    this -> setTxList(txList);
-    this -> setMinFee(minFee);
-    this -> updateAverageFee();
+int TxPool::getCapacity(){
+    lock_guard<mutex> guard(this -> lock);
+    return this -> chunkCount * chunkSize;
 }
 
-Mempool::Mempool(list<Transaction> txList, int maxSize, int minFee, float averageFee){
-    this -> setMaxSize(maxSize);
-    this -> setTxList(txList);
-    this -> setMinFee(minFee);
-    this -> setAverageFee(averageFee);
+// DESTRUCTOR
+TxPool::~TxPool(){
+    for (int i = 0; i < this -> chunkCount; i++)
+        delete[] this -> chunks[i];
 }
 
-Mempool::Mempool(const Mempool &obj):maxSize(obj.maxSize), txList(obj.txList), 
-                                     minFee(obj.minFee), averageFee(obj.averageFee) {}
-
+// utility functions
+TxPool& TxPool::global(){
+    // the pool every handle points into
+    // it is never destroyed, so handles held by static objects are still valid when the program exits
+    static TxPool *pool = new TxPool();
+    return *pool;
+}
 
-// GETTERS
-const list<Transaction>& Mempool::getTxList() const{
-    return this -> txList;
+TxPool::Slot& TxPool::slot(int index) const{
+    return this -> chunks[index / chunkSize][index % chunkSize];
 }
 
-int Mempool::getMaxSize() const{
-    return this -> maxSize;
+int TxPool::create(const Transaction &tx){
+    // stores a transaction in a free slot and returns its index (the caller holds the only reference)
+    lock_guard<mutex> guard(this -> lock);
+    if (this -> freeHead == -1){
+        if (this -> chunkCount == maxChunks){
+            sysMessage("The transaction pool is full. The transaction was not stored.");
+            return -1;
+        }
+        // allocate a new chunk and chain all of its slots in the free list
+        Slot *chunk = new Slot[chunkSize];
+        int base = this -> chunkCount * chunkSize;
+        for (int i = 0; i < chunkSize; i++){
+            chunk[i].refs.store(0, memory_order_relaxed);
+            chunk[i].nextFree = i + 1 < chunkSize ? base + i + 1 : -1;
+        }
+        this -> chunks[this -> chunkCount++] = chunk;
+        this -> freeHead = base;
+    }
+
+    int index = this -> freeHead;
+    Slot &s = this -> slot(index);
+    this -> freeHead = s.nextFree;
+    s.tx = tx;
+    s.refs.store(1, memory_order_relaxed);
+    this -> liveCount++;
+    return index;
 }
 
-int Mempool::getMinFee() const{
-    return this -> minFee;
+void TxPool::retain(int index){
+    this -> slot(index).refs.fetch_add(1, memory_order_relaxed);
 }
 
-float Mempool::getAverageFee() const{
-    return this -> averageFee;
+void TxPool::release(int index){
+    // the last handle gives the slot back to the free list
+    if (this -> slot(index).refs.fetch_sub(1, memory_order_acq_rel) != 1)
+        return;
+    lock_guard<mutex> guard(this -> lock);
+    this -> slot(index).nextFree = this -> freeHead;
+    this -> freeHead = index;
+    this -> liveCount--;
+}
+
+class TxRef{
+    // reference counted handle to a transaction owned by the TxPool, used like a const pointer to the transaction
+    // copying a handle only bumps the reference count, the transaction itself is never copied
+    int index;      // slot in the pool (-1 for an empty handle)
+
+    public:
+        // CONSTRUCTORS
+        TxRef();
+        explicit TxRef(const Transaction &tx);
+        TxRef(const TxRef &obj);
+        TxRef(TxRef &&obj) noexcept;
+
+        // utility functions
+        bool isNull() const;
+        TxRef minedCopy() const;
+        void reset();
+
+        // OPERATORS
+        TxRef& operator=(const TxRef&);
+        TxRef& operator=(TxRef&&) noexcept;
+        const Transaction& operator*() const;
+        const Transaction* operator->() const;
+        bool operator==(const TxRef&) const;
+
+        // GETTERS
+        const Transaction* get() const;
+        int getId() const;
+
+        // DESTRUCTOR
+        ~TxRef();
+};
+
+// CONSTRUCTORS
+TxRef::TxRef():index(-1) {}
+
+TxRef::TxRef(const Transaction &tx){
+    this -> index = TxPool::global().create(tx);
+}
+
+TxRef::TxRef(const TxRef &obj):index(obj.index){
+    if (this -> index != -1)
+        TxPool::global().retain(this -> index);
+}
+
+TxRef::TxRef(TxRef &&obj) noexcept:index(obj.index){
+    obj.index = -1;
+}
+
+// GETTERS
+const Transaction* TxRef::get() const{
+    if (this -> index == -1)
+        return NULL;
+    return &TxPool::global().get(this -> index);
+}
+
+int TxRef::getId() const{
+    // compact id of the transaction (its slot in the pool), unique among the transactions that are still referenced
+    return this -> index;
+}
+
+// DESTRUCTOR
+TxRef::~TxRef(){
+    this -> reset();
+}
+
+// OPERATORS
+TxRef& TxRef::operator=(const TxRef &obj){
+    if (this -> index == obj.index)
+        return *this;
+    // retain first, obj might only be kept alive by this handle
+    if (obj.index != -1)
+        TxPool::global().retain(obj.index);
+    this -> reset();
+    this -> index = obj.index;
+    return *this;
+}
+
+TxRef& TxRef::operator=(TxRef &&obj) noexcept{
+    if (this == &obj)
+        return *this;
+    this -> reset();
+    this -> index = obj.index;
+    obj.index = -1;
+    return *this;
+}
+
+const Transaction& TxRef::operator*() const{
+    return TxPool::global().get(this -> index);
+}
+
+const Transaction* TxRef::operator->() const{
+    return &TxPool::global().get(this -> index);
+}
+
+bool TxRef::operator==(const TxRef &obj) const{
+    // two handles are equal if they point to the same stored transaction
+    return this -> index == obj.index;
+}
+
+// utility functions
+bool TxRef::isNull() const{
+    return this -> index == -1;
+}
+
+TxRef TxRef::minedCopy() const{
+    // pooled transactions are never modified (other chains or copies might hold them),
+    // a mined transaction is a new copy with the flag set
+    if (this -> index == -1)
+        return TxRef();
+    Transaction mined = **this;
+    mined.setIsMined(true);
+    return TxRef(mined);
+}
+
+void TxRef::reset(){
+    if (this -> index != -1)
+        TxPool::global().release(this -> index);
+    this -> index = -1;
+}
+
+// ----------------- MEMPOOL -----------------
+
+class FeeSketch{
+    // streaming histogram of fees used to estimate percentiles without keeping the fees sorted
+    // fees below linearLimit (in 1/100 coins) are counted exactly, larger ones go in logarithmic buckets
+    // which are at most 1% off. counts are also kept per group of buckets so a query only walks a few groups
+    static const int linearLimit = 1024;
+    static const int bucketCount = 1792;
+    static const int groupSize = 64;
+
+    vector<int> counts;         // number of fees in each bucket
+    vector<int> groupCounts;    // number of fees in each group of groupSize buckets
+    int total;
+
+    static int bucketOf(int fee);
+    static int valueOf(int bucket);
+
+    public:
+        // CONSTRUCTORS
+        FeeSketch();
+
+        // utility functions
+        void add(int fee);
+        void remove(int fee);
+        void clear();
+        int quantile(float q) const;
+
+        // GETTERS
+        int getTotal() const;
+};
+
+// CONSTRUCTORS
+FeeSketch::FeeSketch():counts(bucketCount, 0), groupCounts(bucketCount / groupSize, 0), total(0) {}
+
+// GETTERS
+int FeeSketch::getTotal() const{
+    return this -> total;
+}
+
+// utility functions
+int FeeSketch::bucketOf(int fee){
+    if (fee < linearLimit)
+        return max(fee, 0);
+    int bucket = linearLimit + int(log(double(fee) / linearLimit) / log(1.02));
+    return min(bucket, bucketCount - 1);
+}
+
+int FeeSketch::valueOf(int bucket){
+    // representative value of a bucket (the middle of its range for logarithmic buckets)
+    if (bucket < linearLimit)
+        return bucket;
+    return int(round(linearLimit * pow(1.02, bucket - linearLimit) * 1.01));
+}
+
+void FeeSketch::add(int fee){
+    int bucket = bucketOf(fee);
+    this -> counts[bucket]++;
+    this -> groupCounts[bucket / groupSize]++;
+    this -> total++;
+}
+
+void FeeSketch::remove(int fee){
+    int bucket = bucketOf(fee);
+    if (this -> counts[bucket] == 0)
+        return;
+    this -> counts[bucket]--;
+    this -> groupCounts[bucket / groupSize]--;
+    this -> total--;
+}
+
+void FeeSketch::clear(){
+    fill(this -> counts.begin(), this -> counts.end(), 0);
+    fill(this -> groupCounts.begin(), this -> groupCounts.end(), 0);
+    this -> total = 0;
+}
+
+int FeeSketch::quantile(float q) const{
+    // returns the fee below which a fraction q of the fees are (q is between 0 and 1)
+    if (this -> total == 0)
+        return 0;
+    q = min(max(q, 0.0f), 1.0f);
+    int rank = int(q * (this -> total - 1));    // 0-based position of the fee we are looking for
+
+    int group = 0;
+    while (rank >= this -> groupCounts[group]){
+        rank -= this -> groupCounts[group];
+        group++;
+    }
+    int bucket = group * groupSize;
+    while (rank >= this -> counts[bucket]){
+        rank -= this -> counts[bucket];
+        bucket++;
+    }
+    return valueOf(bucket);
+}
+
+class Mempool{
+    // The mempool is a list of transactions that are waiting to be mined
+    // the list holds handles to the pooled transactions (so pointers to them stay valid), lookups go through the indexes below
+    public:
+        typedef multimap<int, const Transaction*> NonceQueue;   // nonce -> tx (for a single sender)
+
+    private:
+    typedef list<TxRef>::iterator TxIt;
+    typedef multimap<int, TxIt> FeeIndex;
+
+    list<TxRef> txList;         // transactions not yet included in a block (shared with the wallets and later the block)
+    unordered_map<Hash, FeeIndex::iterator> txIndex;    // hash -> entry in feeIndex (O(1) lookup and delete)
+    FeeIndex feeIndex;          // transactions ordered by fee, lowest first (O(log n) insert and eviction)
+    unordered_map<Address, NonceQueue> senderQueues;    // sender -> its transactions ordered by nonce (used for block building)
+    int maxSize;                // maximum number of transactions that can be stored in the mempool (DDoS securtity measure)
+    int minFee;                 // minimum fee for a transaction to be included in the mempool
+    float averageFee;           // average fee of transactions in the mempool
+
+    // fee statistics, updated on every insert and delete
+    long long feeSum;           // sum of the fees of transactions in the mempool
+    bool trackFeePercentiles;   // the sketch is optional since percentiles are only needed for fee estimation
+    FeeSketch feeSketch;
+
+    void indexTx(TxIt);
+    void rebuildIndex();
+    void eraseTx(FeeIndex::iterator);
+    bool acceptsTx(const Transaction&) const;
+
+    public:
+        // CONSTRUCTORS
+        Mempool();
+        Mempool(list<Transaction> txList);
+        Mempool(list<Transaction> txList, int maxSize);
+        Mempool(list<Transaction> txList, int maxSize, int minFee);
+        Mempool(list<Transaction> txList, int maxSize, int minFee, float averageFee);
+        Mempool(const Mempool &obj);
+
+        // utility functions
+        void updateAverageFee();
+        bool addTx(const Transaction&);
+        bool addTx(const TxRef&);
+        vector<TxRef> addTxBatch(const vector<Transaction>&, vector<char> &statuses, vector<TxRef> &evicted);
+        void deleteTx(const Hash&);
+        bool hasTx(const Hash&) const;
+        const Transaction* getTx(const Hash&) const;
+        TxRef getTxRef(const Hash&) const;
+        bool isFull() const;
+        bool checkIndexes() const;
+        const Transaction* getLowestFeeTx() const;
+        const Transaction* getHighestFeeTx() const;
+        Transaction evictLowestFee();
+        vector<TxRef> evictBelow(const unordered_map<Address, int> &watermarks);
+        const NonceQueue* getSenderQueue(const Address&) const;
+
+        // OPERATORS
+        Mempool& operator=(const Mempool&);
+        Transaction operator[](const Hash&);
+        Mempool& operator--();
+        Mempool operator--(int);
+        Mempool operator+(Mempool&);
+        Mempool operator-(Mempool&);
+        bool operator<(const Mempool &obj) const;
+        bool operator<=(const Mempool &obj) const;
+        bool operator>(const Mempool &obj);
+        bool operator>=(const Mempool &obj);
+        bool operator==(const Mempool &obj) const;
+        operator list<Transaction>() const;
+
+        // GETTERS
+        const list<TxRef>& getTxList() const;
+        const unordered_map<Address, NonceQueue>& getSenderQueues() const;
+        int getMaxSize() const;
+        int getMinFee() const;
+        float getAverageFee() const;
+        bool getTrackFeePercentiles() const;
+        float getFeePercentile(float) const;
+        float getFeeP50() const;
+        float getFeeP90() const;
+        float getFeeP99() const;
+
+        // SETTERS
+        void setTxList(list<Transaction>);
+        void setTxList(list<TxRef>);
+        void setMaxSize(int);
+        void setMinFee(int);
+        void setAverageFee(float);
+        void setTrackFeePercentiles(bool);
+
+        // DESTRUCTOR
+        ~Mempool();
+};
+
+// CONSTRUCTORS
+Mempool::Mempool():maxSize(1024), minFee(25), averageFee(0), feeSum(0), trackFeePercentiles(true) {} // txList is empty by default
+
+Mempool::Mempool(list<Transaction> txList):maxSize(1024), minFee(25), feeSum(0), trackFeePercentiles(true){
+    this -> setTxList(txList);
+    this -> updateAverageFee();
+}
+
+Mempool::Mempool(list<Transaction> txList, int maxSize):minFee(25), feeSum(0), trackFeePercentiles(true){
+    this -> setMaxSize(maxSize);
+    this -> setTxList(txList);
+    this -> updateAverageFee();
+}
+
+Mempool::Mempool(list<Transaction> txList, int maxSize, int minFee):feeSum(0), trackFeePercentiles(true){
+    this -> setMaxSize(maxSize);
+    this -> setTxList(txList);
+    this -> setMinFee(minFee);
+    this -> updateAverageFee();
+}
+
+Mempool::Mempool(list<Transaction> txList, int maxSize, int minFee, float averageFee):feeSum(0), trackFeePercentiles(true){
+    this -> setMaxSize(maxSize);
+    this -> setTxList(txList);
+    this -> setMinFee(minFee);
+    this -> setAverageFee(averageFee);
+}
+
+Mempool::Mempool(const Mempool &obj):maxSize(obj.maxSize), txList(obj.txList), 
+                                     minFee(obj.minFee), averageFee(obj.averageFee), feeSum(0), 
+                                     trackFeePercentiles(obj.trackFeePercentiles){
+    // the indexes point into obj's list, so they are rebuilt for the copied one
+    this -> rebuildIndex();
+}
+
+
+// GETTERS
+const list<TxRef>& Mempool::getTxList() const{
+    return this -> txList;
+}
+
+const unordered_map<Address, Mempool::NonceQueue>& Mempool::getSenderQueues() const{
+    return this -> senderQueues;
+}
+
+int Mempool::getMaxSize() const{
+    return this -> maxSize;
+}
+
+int Mempool::getMinFee() const{
+    return this -> minFee;
+}
+
+float Mempool::getAverageFee() const{
+    return this -> averageFee;
+}
+
+bool Mempool::getTrackFeePercentiles() const{
+    return this -> trackFeePercentiles;
+}
+
+float Mempool::getFeePercentile(float q) const{
+    // returns the estimated fee percentile q (between 0 and 1) in coins
+    if (!this -> trackFeePercentiles){
+        sysMessage("Fee percentiles are not tracked by this mempool.");
+        return 0;
+    }
+    return float(this -> feeSketch.quantile(q)) / 100;
+}
+
+float Mempool::getFeeP50() const{
+    return this -> getFeePercentile(0.5);
+}
+
+float Mempool::getFeeP90() const{
+    return this -> getFeePercentile(0.9);
+}
+
+float Mempool::getFeeP99() const{
+    return this -> getFeePercentile(0.99);
 }
 
 // SETTERS
 void Mempool::setTxList(list<Transaction> txList){
+    // every transaction is stored in the pool once, the mempool keeps handles to them
+    list<TxRef> refs;
+    for (auto it = txList.begin(); it != txList.end(); it++)
+        refs.push_back(TxRef(*it));
+    this -> setTxList(move(refs));
+}
+
+void Mempool::setTxList(list<TxRef> txList){
     if (txList.size() > this -> maxSize){
         sysMessage("The number of transactions in the list exceeds the maximum size of the mempool. The list was not set.");
         return;
     }
-    this -> txList = txList;    // deep copy
+    this -> txList = move(txList);  // the transactions are shared, not copied
+    this -> rebuildIndex();
     this -> updateAverageFee();
 }
 
@@ -652,9 +1679,21 @@ void Mempool::setAverageFee(float averageFee){
     this -> averageFee = averageFee;
 }
 
+void Mempool::setTrackFeePercentiles(bool trackFeePercentiles){
+    if (trackFeePercentiles == this -> trackFeePercentiles)
+        return;
+    this -> trackFeePercentiles = trackFeePercentiles;
+
+    // fill the sketch with the transactions already in the mempool
+    this -> feeSketch.clear();
+    if (trackFeePercentiles)
+        for (auto it = this -> txList.begin(); it != this -> txList.end(); it++)
+            this -> feeSketch.add((*it) -> getFee());
+}
+
 // DESTRUCTOR
 Mempool::~Mempool(){
-    // since the txList holds objects and not pointers, there's nothing to delete manually
+    // the handles in txList release the pooled transactions by themselves
 }
 
 // OPERATORS
@@ -674,7 +1713,7 @@ istream& operator>>(istream& in, Mempool &obj){
     char choice;
     in >> choice;
     while (choice == 'Y' || choice == 'y'){
-        if (txList.size() >= maxSize){
+        if (int(txList.size()) >= maxSize){
             sysMessage("The mempool is full. No more transactions can be added.");
             break;
         }
@@ -703,6 +1742,8 @@ ostream& operator<<(ostream& out, const Mempool &obj){
     out << "Maximum size of the mempool: " << obj.getMaxSize() << endl;
     out << "Minimum fee for a transaction to be included in the mempool: " << float(obj.getMinFee()) / 100 << endl;
     out << "Average fee of transactions in the mempool: " << obj.getAverageFee() << endl;
+    if (obj.getTrackFeePercentiles() && !obj.getTxList().empty())
+        out << "Fee percentiles (p50 / p90 / p99): " << obj.getFeeP50() << " / " << obj.getFeeP90() << " / " << obj.getFeeP99() << endl;
 
     if (obj.getTxList().empty()){
         out << "The mempool is empty.\n";
@@ -712,7 +1753,7 @@ ostream& operator<<(ostream& out, const Mempool &obj){
     out << "Transactions in the mempool: \n\n";
     int i = 0;
     for (auto it = obj.getTxList().begin(); it != obj.getTxList().end(); it++)
-        out << *it << endl;
+        out << **it << endl;
     return out;
 }
 
@@ -720,17 +1761,18 @@ Mempool& Mempool::operator=(const Mempool &obj){
     if (this == &obj)
         return *this;
 
+    this -> trackFeePercentiles = obj.trackFeePercentiles;
+    this -> setMaxSize(obj.maxSize);     // first, so a list larger than the old maximum is accepted
     this -> setTxList(obj.txList);
-    this -> setMaxSize(obj.maxSize);
     this -> setMinFee(obj.minFee);
 
     return *this;
 }
 
-Transaction Mempool::operator[](string hash){
-    for (auto it = this -> txList.begin(); it != this -> txList.end(); it++)
-        if ((*it).getHash() == hash)
-            return *it;
+Transaction Mempool::operator[](const Hash &hash){
+    const Transaction *tx = this -> getTx(hash);
+    if (tx)
+        return *tx;
     sysMessage("The transaction with the hash provided was not found in the mempool.");
     return Transaction(); 
 }
@@ -741,7 +1783,8 @@ Mempool& Mempool::operator--(){
         sysMessage("The mempool is empty. No transactions to remove.");
         return *this;
     }
-    this -> txList.pop_back();
+    this -> eraseTx(this -> txIndex[this -> txList.back() -> getHash()]);
+    this -> updateAverageFee();
     return *this;
 }
 
@@ -786,7 +1829,7 @@ Mempool Mempool::operator-(Mempool &obj){
 
     Mempool copy = *this;
     for (auto it = obj.txList.begin(); it != obj.txList.end(); it++)
-        copy.deleteTx((*it).getHash());
+        copy.deleteTx((*it) -> getHash());
 
     return copy;
 }
@@ -817,101 +1860,367 @@ bool Mempool::operator==(const Mempool &obj) const{
     if (this -> txList.size() != obj.txList.size())
         return false;
     
-    for (auto it = this -> txList.begin(); it != this -> txList.end(); it++){
-        bool found = false;
-        for (auto it2 = obj.txList.begin(); it2 != obj.txList.end(); it2++){
-            if ((*it) == (*it2)){
-                found = true;
-                break;
-            }
-        }
-        if (!found)
+    for (auto it = this -> txList.begin(); it != this -> txList.end(); it++)
+        if (!obj.hasTx((*it) -> getHash()))
             return false;
-    }
     return true;
 }
 
 Mempool::operator list<Transaction>() const{
-    return this -> txList;
+    list<Transaction> txs;
+    for (auto it = this -> txList.begin(); it != this -> txList.end(); it++)
+        txs.push_back(**it);
+    return txs;
 }
 
 // utility functions
 void Mempool::updateAverageFee(){
     // updates the average fee of transactions from the mempool
-    float aux = 0;
-    int ct = 0;
-    for (auto it = txList.begin(); it != txList.end(); it++){
-        aux += (*it).getFee();
-        ct++;
-    }
+    // the sum of the fees is kept up to date on every insert and delete, so this is O(1)
 
     // handle nan float case
-    if (aux == 0)
+    if (this -> txList.empty())
         this -> setAverageFee(0);
-    else this -> setAverageFee((aux / ct) / 100.0);
+    else this -> setAverageFee((float(this -> feeSum) / this -> txList.size()) / 100.0);
 }
 
-void Mempool::addTx(Transaction &tx){
-    // adds a transaction in the mempool
+bool Mempool::acceptsTx(const Transaction &tx) const{
+    // checks if a transaction can be added to the mempool
     if (!tx.isMineable()){
         sysMessage("The transaction is not mineable. It will not be added to the mempool.");
-        return;
+        return false;
     }
-    if (txList.size() >= maxSize){
+    if (int(txList.size()) >= maxSize){
         sysMessage("The mempool is full. No more transactions can be added.");
-        return;
+        return false;
     }
     if (tx.getFee() < this -> minFee){
         sysMessage("The fee of the transaction is less than the minimum fee required for a transaction to be included in the mempool. The transaction will not be added.");
-        return;
+        return false;
     }
+    if (this -> hasTx(tx.getHash())){
+        sysMessage("The transaction is already in the mempool. It will not be added again.");
+        return false;
+    }
+    return true;
+}
+
+bool Mempool::addTx(const Transaction &tx){
+    // adds a transaction in the mempool (the transaction is stored in the pool)
+    // returns false if the transaction was rejected
+    if (!this -> acceptsTx(tx))
+        return false;
+    this -> txList.push_back(TxRef(tx));
+    this -> indexTx(prev(this -> txList.end()));
+    this -> updateAverageFee();
+    return true;
+}
+
+bool Mempool::addTx(const TxRef &tx){
+    // adds an already pooled transaction in the mempool, the transaction is shared and not copied
+    // returns false if the transaction was rejected
+    if (tx.isNull() || !this -> acceptsTx(*tx))
+        return false;
     this -> txList.push_back(tx);
+    this -> indexTx(prev(this -> txList.end()));
     this -> updateAverageFee();
+    return true;
 }
 
-void Mempool::deleteTx(string hash){
-    // removes a transaction from the mempool given its hash
-    for (auto it = txList.begin(); it != txList.end(); it++){
-        if ((*it).getHash() == hash){
-            txList.erase(it);
-            this -> updateAverageFee();
-            return;
+vector<TxRef> Mempool::addTxBatch(const vector<Transaction> &txs, vector<char> &statuses, vector<TxRef> &evicted){
+    // adds the transactions whose status is 'A' (the state checks are done by the caller, see Blockchain::sendTxBatch)
+    // the checks of addTx are applied as well and set the status of a rejected transaction (I, L or D, same letters)
+    // the hash index grows once and the average fee is updated once for the whole batch
+    // when the mempool is full a transaction paying more replaces the cheapest one (returned in evicted),
+    // otherwise its status becomes 'F'. returns the handle of every added transaction (empty for the others)
+    vector<TxRef> added(txs.size());
+    statuses.resize(txs.size(), 'A');
+    this -> txIndex.reserve(min<size_t>(this -> txIndex.size() + txs.size(), this -> maxSize));
+    for (size_t i = 0; i < txs.size(); i++){
+        if (statuses[i] != 'A')
+            continue;
+        if (!txs[i].isMineable()){
+            statuses[i] = 'I';
+            continue;
+        }
+        if (txs[i].getFee() < this -> minFee){
+            statuses[i] = 'L';
+            continue;
+        }
+        if (this -> hasTx(txs[i].getHash())){
+            statuses[i] = 'D';      // also an earlier transaction of the batch (it is indexed already)
+            continue;
+        }
+        if (int(this -> txList.size()) >= this -> maxSize){
+            if (this -> feeIndex.empty() || this -> feeIndex.begin() -> first >= txs[i].getFee()){
+                statuses[i] = 'F';
+                continue;
+            }
+            evicted.push_back(*(this -> feeIndex.begin() -> second));
+            this -> eraseTx(this -> feeIndex.begin());
         }
+        this -> txList.push_back(TxRef(txs[i]));
+        this -> indexTx(prev(this -> txList.end()));
+        added[i] = this -> txList.back();
     }
-    warning("The transaction with the hash provided was not found in the mempool.");
+    this -> updateAverageFee();
+    return added;
+}
 
+void Mempool::deleteTx(const Hash &hash){
+    // removes a transaction from the mempool given its hash
+    auto it = this -> txIndex.find(hash);
+    if (it == this -> txIndex.end()){
+        warning("The transaction with the hash provided was not found in the mempool.");
+        return;
+    }
+    this -> eraseTx(it -> second);
+    this -> updateAverageFee();
 }
 
-// ----------------- WALLET -----------------
+bool Mempool::hasTx(const Hash &hash) const{
+    return this -> txIndex.find(hash) != this -> txIndex.end();
+}
 
-class Wallet{
-    // the wallet keeps track of an address' balance and nonce
-    // the nonce is a value that needs to be incremented for every transaction (to prevent someone from speding it twice)
-    // since this is a simulator, the wallet also keeps track of some other statistics for UX
-    // txList and averageSpent are not actually required for the blockchain to function, but they are useful for the user
-    string address;
+const Transaction* Mempool::getTx(const Hash &hash) const{
+    // returns a pointer to the transaction with the given hash (NULL if it is not in the mempool)
+    auto it = this -> txIndex.find(hash);
+    if (it == this -> txIndex.end())
+        return NULL;
+    return it -> second -> second -> get();
+}
+
+TxRef Mempool::getTxRef(const Hash &hash) const{
+    // returns a handle to the transaction with the given hash (an empty handle if it is not in the mempool)
+    auto it = this -> txIndex.find(hash);
+    if (it == this -> txIndex.end())
+        return TxRef();
+    return *(it -> second -> second);
+}
+
+bool Mempool::isFull() const{
+    return int(this -> txList.size()) >= this -> maxSize;
+}
+
+bool Mempool::checkIndexes() const{
+    // true if the indexes describe exactly the transactions of txList (used by the scenario checks)
+    if (this -> txIndex.size() != this -> txList.size() || this -> feeIndex.size() != this -> txList.size())
+        return false;
+    long long feeSum = 0;
+    for (auto it = this -> txList.begin(); it != this -> txList.end(); it++){
+        auto found = this -> txIndex.find((*it) -> getHash());
+        if (found == this -> txIndex.end() || found -> second -> second -> get() != it -> get() ||
+            found -> second -> first != (*it) -> getFee())
+            return false;
+        feeSum += (*it) -> getFee();
+    }
+
+    size_t queued = 0;
+    for (auto queue = this -> senderQueues.begin(); queue != this -> senderQueues.end(); queue++){
+        for (auto it = queue -> second.begin(); it != queue -> second.end(); it++)
+            if (it -> second -> getFrom() != queue -> first || it -> first != it -> second -> getNonce() ||
+                this -> getTx(it -> second -> getHash()) != it -> second)
+                return false;
+        queued += queue -> second.size();
+    }
+    return queued == this -> txList.size() && feeSum == this -> feeSum;
+}
+
+const Transaction* Mempool::getLowestFeeTx() const{
+    // the first transaction to be evicted if the mempool is full (the oldest one if fees are equal)
+    if (this -> feeIndex.empty())
+        return NULL;
+    return this -> feeIndex.begin() -> second -> get();
+}
+
+const Transaction* Mempool::getHighestFeeTx() const{
+    if (this -> feeIndex.empty())
+        return NULL;
+    return prev(this -> feeIndex.end()) -> second -> get();
+}
+
+Transaction Mempool::evictLowestFee(){
+    // removes the transaction with the lowest fee and returns it
+    // whoever holds pointers to it (wallets) is responsible for dropping them
+    if (this -> feeIndex.empty()){
+        sysMessage("The mempool is empty. No transactions to evict.");
+        return Transaction();
+    }
+    Transaction evicted = **(this -> feeIndex.begin() -> second);
+    this -> eraseTx(this -> feeIndex.begin());
+    this -> updateAverageFee();
+    return evicted;
+}
+
+vector<TxRef> Mempool::evictBelow(const unordered_map<Address, int> &watermarks){
+    // removes every transaction whose nonce is at or below the watermark of its sender (sender -> last used nonce)
+    // and returns them, so whoever holds handles to them (wallets) can drop them in one batch
+    // the sender queues are ordered by nonce, so only the superseded transactions are visited
+    vector<TxRef> evicted;
+    for (auto it = watermarks.begin(); it != watermarks.end(); it++){
+        auto queue = this -> senderQueues.find(it -> first);
+        if (queue == this -> senderQueues.end())
+            continue;
+        auto end = queue -> second.upper_bound(it -> second);
+        for (auto qIt = queue -> second.begin(); qIt != end; qIt++){
+            auto indexIt = this -> txIndex.find(qIt -> second -> getHash());
+            FeeIndex::iterator feeIt = indexIt -> second;
+            TxIt txIt = feeIt -> second;
+
+            this -> feeSum -= (*txIt) -> getFee();
+            if (this -> trackFeePercentiles)
+                this -> feeSketch.remove((*txIt) -> getFee());
+            evicted.push_back(move(*txIt));     // the handle keeps the transaction alive for the caller
+            this -> txIndex.erase(indexIt);
+            this -> feeIndex.erase(feeIt);
+            this -> txList.erase(txIt);
+        }
+        queue -> second.erase(queue -> second.begin(), end);
+        if (queue -> second.empty())
+            this -> senderQueues.erase(queue);
+    }
+    if (!evicted.empty())
+        this -> updateAverageFee();
+    return evicted;
+}
+
+const Mempool::NonceQueue* Mempool::getSenderQueue(const Address &sender) const{
+    // returns the transactions of a sender ordered by nonce (NULL if there are none)
+    auto it = this -> senderQueues.find(sender);
+    if (it == this -> senderQueues.end())
+        return NULL;
+    return &it -> second;
+}
+
+void Mempool::indexTx(TxIt it){
+    // registers a transaction from txList in the indexes
+    FeeIndex::iterator feeIt = this -> feeIndex.insert(make_pair(int((*it) -> getFee()), it));
+    this -> txIndex[(*it) -> getHash()] = feeIt;
+    this -> senderQueues[(*it) -> getFrom()].insert(make_pair((*it) -> getNonce(), it -> get()));
+
+    this -> feeSum += (*it) -> getFee();
+    if (this -> trackFeePercentiles)
+        this -> feeSketch.add((*it) -> getFee());
+}
+
+void Mempool::rebuildIndex(){
+    // rebuilds both indexes from txList (duplicated hashes are dropped)
+    this -> txIndex.clear();
+    this -> feeIndex.clear();
+    this -> senderQueues.clear();
+    this -> feeSum = 0;
+    this -> feeSketch.clear();
+    int dropped = 0;
+    for (auto it = this -> txList.begin(); it != this -> txList.end();){
+        if (this -> hasTx((*it) -> getHash())){
+            it = this -> txList.erase(it);
+            dropped++;
+            continue;
+        }
+        this -> indexTx(it);
+        it++;
+    }
+    if (dropped > 0)
+        warning(to_string(dropped) + " transactions with the same hash as an earlier one were dropped from the mempool.");
+}
+
+void Mempool::eraseTx(FeeIndex::iterator feeIt){
+    // removes a transaction from the indexes and from txList (does not update the average fee)
+    TxIt it = feeIt -> second;
+    auto queue = this -> senderQueues.find((*it) -> getFrom());
+    auto range = queue -> second.equal_range((*it) -> getNonce());
+    for (auto qIt = range.first; qIt != range.second; qIt++){
+        if (qIt -> second == it -> get()){
+            queue -> second.erase(qIt);
+            break;
+        }
+    }
+    if (queue -> second.empty())
+        this -> senderQueues.erase(queue);
+
+    this -> feeSum -= (*it) -> getFee();
+    if (this -> trackFeePercentiles)
+        this -> feeSketch.remove((*it) -> getFee());
+
+    this -> txIndex.erase((*it) -> getHash());
+    this -> feeIndex.erase(feeIt);
+    this -> txList.erase(it);
+}
+
+// ----------------- WALLET -----------------
+
+class Wallet{
+    // the wallet keeps track of an address' balance and nonce
+    // the nonce is a value that needs to be incremented for every transaction (to prevent someone from speding it twice)
+    // since this is a simulator, the wallet also keeps track of some other statistics for UX
+    // the history and averageSpent are not actually required for the blockchain to function, but they are useful for the user
+    public:
+        struct HistoryKey{
+            int height;     // height of the block which included the tx (pendingHeight while it waits in the mempool)
+            int nonce;
+            int id;         // id of the tx, so two entries never share a key
+
+            bool operator<(const HistoryKey&) const;
+        };
+        typedef map<HistoryKey, TxRef> History;         // transactions ordered by (height, nonce), oldest first
+        static const int pendingHeight = INT_MAX;
+        static const int statsWindow = 32;              // number of mined outgoing txs in the rolling mean
+
+        struct Stats{
+            // running aggregates over the history, updated in O(1) (O(log n) for the extremes) when a tx is added, deleted or mined
+            long long totalSent, totalReceived;     // amounts of the outgoing / incoming txs (pending ones included)
+            int sentCount, receivedCount;
+            int minSent, maxSent;                   // extremes of the outgoing amounts (0 if nothing was sent)
+            int recentSent[statsWindow];            // amounts of the last mined outgoing txs (ring buffer)
+            HistoryKey recentKeys[statsWindow];     // history keys of those txs (to find them and the next older one when one is deleted)
+            int recentCount, recentNext;
+            long long recentSum;
+
+            Stats();
+            float getRecentAverage() const;
+        };
+
+    private:
+    Address address;
     int balance;
     int nonce;
-    list<const Transaction*> txList;    // pointers to mined txs (in blocks) or txs from the mempool
+    History history;                    // mined txs (in blocks) and txs from the mempool
+    History incoming;                   // the part of the history received from other addresses
+    unordered_map<int, History::iterator> txIndex;      // tx id -> entry in history (O(1) lookup, O(log n) delete)
     float averageSpent;                 // average amount of coins spent in transactions
+    Stats stats;
+    multiset<int> sentAmounts;          // outgoing amounts, ordered so the extremes survive deletes
+
+    bool isIncoming(const Transaction&) const;
+    void rebuildIndex();
+    void countTx(const Transaction&, int sign);
+    void pushRecent(const HistoryKey&, int amount);
+    int recentSlot(int position) const;
+    int findRecent(int id) const;
+    void dropRecent(int position);
 
     public:
         // CONSTRUCTORS
         Wallet();
-        Wallet(string address);
-        Wallet(string address, int balance);
-        Wallet(string address, int balance, int nonce, list<const Transaction*> txList, float averageSpent);
+        Wallet(const Address &address);
+        Wallet(const Address &address, int balance);
+        Wallet(const Address &address, int balance, int nonce, History history, float averageSpent);
         Wallet(const Wallet &obj);
 
         // utility functions
-        void updateTx(string, const Transaction*);
-        void deleteTx(string);
-        void addTx(const Transaction*);
+        void deleteTx(const Hash&);
+        void deleteTx(int id);
+        void addTx(const TxRef&, int height = pendingHeight);
+        void confirmTx(int id, const TxRef&, int height);
+        bool hasTx(int id) const;
+        const Transaction* getTx(int id) const;
+        vector<TxRef> getLastTxs(int count, bool incomingOnly = false) const;
+        vector<TxRef> getTxsBetween(int fromHeight, int toHeight, int page, int pageSize, bool incomingOnly = false) const;
         void updateAverageSpent();
 
         // OPERATORS
         Wallet& operator=(const Wallet&);
-        Transaction operator[](string);
+        Transaction operator[](const Hash&);
         Wallet& operator++();
         Wallet operator++(int);
         Wallet operator+(int);
@@ -922,17 +2231,20 @@ class Wallet{
         operator pair<string, int>() const;
 
         // GETTERS
-        string getAddress() const;
+        const Address& getAddress() const;
         int getBalance() const;
         int getNonce() const;
-        const list<const Transaction*>& getTxList() const;
+        const History& getHistory() const;
+        int getHistorySize() const;
         float getAverageSpent() const;
+        const Stats& getStats() const;
 
         // SETTERS
         void setAddress(string);
+        void setAddress(const Address&);
         void setBalance(int);
         void setNonce(int);
-        void setTxList(list<const Transaction*>);
+        void setHistory(History);
         void setAverageSpent(float);
 
         // DESTRUCTOR
@@ -942,46 +2254,31 @@ class Wallet{
 
 // CONSTRUCTORS
 Wallet::Wallet():balance(0), nonce(0), averageSpent(0) {
-    this -> address = generateRandomHex();
-    // txList is empty by default
-}
-
-Wallet::Wallet(string address):balance(0), nonce(0), averageSpent(0){
-    if (!isAddress(address)){
-        sysMessage("The string is not an address. A random address has been generated.");
-        this -> address = generateRandomHex();
-    }
-    else this -> address = address;
+    this -> address = Address(generateRandomHex());
+    // the history is empty by default
 }
 
-Wallet::Wallet(string address, int balance):nonce(0), averageSpent(0){
-    if (!isAddress(address)){
-        sysMessage("The string is not an address. A random address has been generated.");
-        this -> address = generateRandomHex();
-    }
-    else this -> address = address;
+Wallet::Wallet(const Address &address):address(address), balance(0), nonce(0), averageSpent(0) {}
 
+Wallet::Wallet(const Address &address, int balance):address(address), nonce(0), averageSpent(0){
     this -> setBalance(balance);
 }
 
-Wallet::Wallet(string address, int balance, int nonce, list<const Transaction*> txList, float averageSpent){
-    if (!isAddress(address)){
-        sysMessage("The string is not an address. A random address has been generated.");
-        this -> address = generateRandomHex();
-    }
-    else this -> address = address;
-
+Wallet::Wallet(const Address &address, int balance, int nonce, History history, float averageSpent):address(address){
     this -> setBalance(balance);
     this -> nonce = nonce;
-    this -> txList = txList;
+    this -> setHistory(move(history));
     this -> averageSpent = averageSpent;
 }
 
 Wallet::Wallet(const Wallet &obj):address(obj.address), balance(obj.balance), nonce(obj.nonce), 
-                                  txList(obj.txList), averageSpent(obj.averageSpent) {}
+                                  history(obj.history), averageSpent(obj.averageSpent){
+    // the indexes point into obj's history, so they are rebuilt for the copied one
+    this -> rebuildIndex();
+}
 
 // GETTERS
-string Wallet::getAddress() const{
+const Address& Wallet::getAddress() const{
     return this -> address;
 }
 
@@ -993,21 +2290,33 @@ int Wallet::getNonce() const{
     return this -> nonce;
 }
 
-const list<const Transaction*>& Wallet::getTxList() const{
-    return this -> txList;
+const Wallet::History& Wallet::getHistory() const{
+    return this -> history;
+}
+
+int Wallet::getHistorySize() const{
+    return this -> history.size();
 }
 
 float Wallet::getAverageSpent() const{
     return this -> averageSpent;
 }
 
+const Wallet::Stats& Wallet::getStats() const{
+    return this -> stats;
+}
+
 // SETTERS
 void Wallet::setAddress(string address){
     if (!isAddress(address)){
         sysMessage("The string is not an address. A random address has been generated.");
-        this -> address = generateRandomHex();
+        this -> address = Address(generateRandomHex());
         return;
     }
+    this -> address = Address(address);
+}
+
+void Wallet::setAddress(const Address &address){
     this -> address = address;
 }
 
@@ -1029,8 +2338,9 @@ void Wallet::setNonce(int nonce){
     this -> nonce = nonce;
 }
 
-void Wallet::setTxList(list<const Transaction*> txList){
-    this -> txList = txList;
+void Wallet::setHistory(History history){
+    this -> history = move(history);
+    this -> rebuildIndex();
     this -> updateAverageSpent();
 }
 
@@ -1045,9 +2355,7 @@ void Wallet::setAverageSpent(float averageSpent){
 
 // DESTRUCTOR
 Wallet::~Wallet(){
-    // we specifically don't want to delete transactions from txList, as those are also kept in blocks/mempool
-    // the mempool will modify these pointers if it hands off a transaction to a block
-    // (or delete the list entry if it dropps the tx from the mempool)
+    // the transactions from the history are shared with the blocks/mempool, the handles only release the wallet's references
     // nothing else is dynamically allocated
 }
 
@@ -1057,7 +2365,7 @@ istream& operator>>(istream &in, Wallet &obj){
     string address;
     double balance;
     string nonce;
-    list<const Transaction*> txList;
+    Wallet::History history;
     float averageSpent;
 
     cout << "Enter the balance of the wallet: ";
@@ -1067,7 +2375,7 @@ istream& operator>>(istream &in, Wallet &obj){
     in.ignore();
     getline(in, address);
     if (address == "god")
-        address = Transaction::getGodAddress();
+        address = Transaction::getGodAddress().toHex();
     else if (address.substr(0,3) != "0x")
         address = generateRandomHex();
     else if (!isAddress(address)){
@@ -1079,7 +2387,7 @@ istream& operator>>(istream &in, Wallet &obj){
     obj.setAddress(address);
     obj.setBalance(round(balance * 100));
     obj.setNonce(0);
-    obj.setTxList(txList);
+    obj.setHistory(history);
     obj.setAverageSpent(0);
 
     return in;
@@ -1091,13 +2399,13 @@ ostream& operator<<(ostream& out, const Wallet &obj){
     out << "Nonce: " << obj.getNonce() << endl;
     out << "Average spent: " << float(obj.getAverageSpent()) / 100 << endl;
 
-    if (obj.getTxList().empty()){
+    if (obj.getHistory().empty()){
         out << "The wallet has no transactions.\n";
         return out;
     }
     out << "Transactions in the wallet: \n\n";
-    for (auto it = obj.getTxList().begin(); it != obj.getTxList().end(); it++){
-        out << **it << endl;
+    for (auto it = obj.getHistory().begin(); it != obj.getHistory().end(); it++){
+        out << *(it -> second) << endl;
     }
     return out;
 }
@@ -1109,16 +2417,17 @@ Wallet& Wallet::operator=(const Wallet &obj){
     this -> address = obj.address;
     this -> balance = obj.balance;
     this -> nonce = obj.nonce;
-    this -> txList = obj.txList;
+    this -> history = obj.history;
+    this -> rebuildIndex();
     this -> averageSpent = obj.averageSpent;
 
     return *this;
 }
 
-Transaction Wallet::operator[](string hash){
-    for (auto it = this -> txList.begin(); it != this -> txList.end(); it++)
-        if ((*it) -> getHash() == hash)
-            return **it;
+Transaction Wallet::operator[](const Hash &hash){
+    for (auto it = this -> history.begin(); it != this -> history.end(); it++)
+        if (it -> second -> getHash() == hash)
+            return *(it -> second);
     sysMessage("The transaction with the hash provided was not found in the wallet.");
     return Transaction();
 }
@@ -1178,60 +2487,350 @@ bool Wallet::operator==(const Wallet &obj){
 }
 
 Wallet::operator pair<string, int>() const{
-    return make_pair(this -> address, this -> balance);
+    return make_pair(this -> address.toHex(), this -> balance);
 }
 
 // utility functions
-void Wallet::addTx(const Transaction *tx){
-    // adds a transaction to the wallet, keeps the list sorted by nonce
-    auto it = this -> txList.begin();
-    for (; it != this -> txList.end(); it++)
-        if ((*it) -> getNonce() > tx -> getNonce())
-            // search where to insert the new tx
-            break;
-    this -> txList.insert(it, tx);
+bool Wallet::HistoryKey::operator<(const HistoryKey &obj) const{
+    if (this -> height != obj.height)
+        return this -> height < obj.height;
+    if (this -> nonce != obj.nonce)
+        return this -> nonce < obj.nonce;
+    return this -> id < obj.id;
+}
+
+bool Wallet::isIncoming(const Transaction &tx) const{
+    // received from another address (a tx to self is only kept as an outgoing one)
+    return tx.getTo() == this -> address && tx.getFrom() != this -> address;
+}
+
+void Wallet::addTx(const TxRef &tx, int height){
+    // adds a transaction to the history, pending transactions are kept after the mined ones
+    if (tx.isNull() || this -> hasTx(tx.getId()))
+        return;
+    HistoryKey key = {height, tx -> getNonce(), tx.getId()};
+    this -> txIndex[tx.getId()] = this -> history.insert(make_pair(key, tx)).first;
+    if (this -> isIncoming(*tx))
+        this -> incoming.insert(make_pair(key, tx));
+
+    this -> countTx(*tx, 1);
+    if (height != pendingHeight && tx -> getFrom() == this -> address)
+        this -> pushRecent(key, tx -> getAmount());
     this -> updateAverageSpent();
 }
 
-void Wallet::updateTx(string hash, const Transaction* tx){
-    // updates the pointer of a tx from the wallet
-    // e.g. if a tx was included in a block, the pointer needs to be updated (the mempool deletes the tx object)
-    for (auto it = this -> txList.begin(); it != this -> txList.end(); it++){
-        if ((**it).getHash() == hash){
-            *it = tx;
-            return;
-        }
+void Wallet::confirmTx(int id, const TxRef &tx, int height){
+    // moves a pending transaction to the block that included it
+    // tx is the handle held by the block (normally the same transaction as the pending one)
+    auto it = this -> txIndex.find(id);
+    if (it == this -> txIndex.end()){
+        this -> addTx(tx, height);
+        return;
+    }
+
+    // the map nodes are reused, only their keys change
+    HistoryKey key = {height, tx -> getNonce(), tx.getId()};
+    if (it -> second -> first.height == pendingHeight && height != pendingHeight && tx -> getFrom() == this -> address)
+        this -> pushRecent(key, tx -> getAmount());
+    auto node = this -> history.extract(it -> second);
+    auto received = this -> incoming.extract(node.key());
+    this -> txIndex.erase(it);
+
+    node.key() = key;
+    node.mapped() = tx;
+    this -> txIndex[tx.getId()] = this -> history.insert(move(node)).position;
+    if (!received.empty()){
+        received.key() = key;
+        received.mapped() = tx;
+        this -> incoming.insert(move(received));
     }
-    sysMessage("Potential memory leak! The transaction with the hash provided was not found in the wallet when trying to update a pointer. Hash: " + hash);
 }
 
-void Wallet::deleteTx(string hash){
-    // removes a transaction from the wallet given its hash
-    for (auto it = this -> txList.begin(); it != this -> txList.end(); it++){
-        Transaction tx = **it;
-        if ((**it).getHash() == hash){
-            txList.erase(it);
+void Wallet::deleteTx(const Hash &hash){
+    // removes a transaction from the wallet given its hash (linear, prefer the id when it is known)
+    for (auto it = this -> history.begin(); it != this -> history.end(); it++){
+        if (it -> second -> getHash() == hash){
+            this -> deleteTx(it -> second.getId());
             return;
         }
     }
     sysMessage("The transaction with the hash provided was not found in the wallet.");
 }
 
-void Wallet::updateAverageSpent(){
-    // updates the average spent by the user (also includes not mined txs)
-    float aux = 0;
-    int ct = 0;
-    for (auto it = this -> txList.begin(); it != this -> txList.end(); it++){
-        if ((*it) -> getFrom() == this -> getAddress()){    
-            aux += (*it) -> getAmount();
-            ct++;
+void Wallet::deleteTx(int id){
+    // removes a transaction from the wallet given its id
+    auto it = this -> txIndex.find(id);
+    if (it == this -> txIndex.end()){
+        sysMessage("The transaction with the id provided was not found in the wallet.");
+        return;
+    }
+    this -> countTx(*(it -> second -> second), -1);
+    int position = it -> second -> first.height != pendingHeight ? this -> findRecent(id) : -1;
+    this -> incoming.erase(it -> second -> first);
+    this -> history.erase(it -> second);
+    this -> txIndex.erase(it);
+    if (position != -1)
+        this -> dropRecent(position);
+    this -> updateAverageSpent();
+}
+
+bool Wallet::hasTx(int id) const{
+    return this -> txIndex.find(id) != this -> txIndex.end();
+}
+
+const Transaction* Wallet::getTx(int id) const{
+    // returns the transaction with the given id (NULL if it is not in the wallet)
+    auto it = this -> txIndex.find(id);
+    if (it == this -> txIndex.end())
+        return NULL;
+    return it -> second -> second.get();
+}
+
+vector<TxRef> Wallet::getLastTxs(int count, bool incomingOnly) const{
+    // returns the newest count transactions, newest first (pending ones come before the mined ones)
+    const History &source = incomingOnly ? this -> incoming : this -> history;
+    vector<TxRef> txs;
+    txs.reserve(min(max(count, 0), int(source.size())));
+    for (auto it = source.rbegin(); it != source.rend() && int(txs.size()) < count; it++)
+        txs.push_back(it -> second);
+    return txs;
+}
+
+vector<TxRef> Wallet::getTxsBetween(int fromHeight, int toHeight, int page, int pageSize, bool incomingOnly) const{
+    // returns a page of the transactions mined between two heights (inclusive), oldest first
+    // the range is found in O(log n), only the pages before the requested one are walked
+    vector<TxRef> txs;
+    if (fromHeight > toHeight || page < 0 || pageSize < 1)
+        return txs;
+    const History &source = incomingOnly ? this -> incoming : this -> history;
+    auto it = source.lower_bound(HistoryKey{fromHeight, INT_MIN, INT_MIN});
+    for (long long skip = (long long)page * pageSize; skip > 0 && it != source.end() && it -> first.height <= toHeight; skip--)
+        it++;
+    for (; it != source.end() && it -> first.height <= toHeight && int(txs.size()) < pageSize; it++)
+        txs.push_back(it -> second);
+    return txs;
+}
+
+void Wallet::rebuildIndex(){
+    // rebuilds the id index, the incoming part and the statistics from the history
+    this -> txIndex.clear();
+    this -> incoming.clear();
+    this -> stats = Stats();
+    this -> sentAmounts.clear();
+    for (auto it = this -> history.begin(); it != this -> history.end();){
+        if (it -> second.isNull() || this -> hasTx(it -> second.getId())){
+            it = this -> history.erase(it);
+            continue;
         }
+        this -> txIndex[it -> second.getId()] = it;
+        if (this -> isIncoming(*(it -> second)))
+            this -> incoming.insert(*it);
+
+        // the history is ordered by height, so the mined txs are pushed in the order they were mined
+        this -> countTx(*(it -> second), 1);
+        if (it -> first.height != pendingHeight && it -> second -> getFrom() == this -> address)
+            this -> pushRecent(it -> first, it -> second -> getAmount());
+        it++;
+    }
+}
+
+void Wallet::countTx(const Transaction &tx, int sign){
+    // adds (sign = 1) or removes (sign = -1) a transaction from the running aggregates
+    if (this -> isIncoming(tx)){
+        this -> stats.totalReceived += sign * tx.getAmount();
+        this -> stats.receivedCount += sign;
+        return;
+    }
+    if (tx.getFrom() != this -> address)
+        return;
+
+    int amount = tx.getAmount();
+    this -> stats.totalSent += sign * amount;
+    this -> stats.sentCount += sign;
+    if (sign > 0)
+        this -> sentAmounts.insert(amount);
+    else this -> sentAmounts.erase(this -> sentAmounts.find(amount));
+    if (this -> sentAmounts.empty())
+        this -> stats.minSent = this -> stats.maxSent = 0;
+    else{
+        this -> stats.minSent = *this -> sentAmounts.begin();
+        this -> stats.maxSent = *this -> sentAmounts.rbegin();
+    }
+}
+
+void Wallet::pushRecent(const HistoryKey &key, int amount){
+    // adds a mined outgoing amount to the rolling window (the oldest one is dropped once it is full)
+    if (this -> stats.recentCount == statsWindow)
+        this -> stats.recentSum -= this -> stats.recentSent[this -> stats.recentNext];
+    else this -> stats.recentCount++;
+    this -> stats.recentSent[this -> stats.recentNext] = amount;
+    this -> stats.recentKeys[this -> stats.recentNext] = key;
+    this -> stats.recentSum += amount;
+    this -> stats.recentNext = (this -> stats.recentNext + 1) % statsWindow;
+}
+
+int Wallet::recentSlot(int position) const{
+    // index in the ring buffer of the position-th tx of the window (0 is the oldest)
+    return (this -> stats.recentNext - this -> stats.recentCount + position + statsWindow) % statsWindow;
+}
+
+int Wallet::findRecent(int id) const{
+    // position of the tx in the rolling window, -1 if it is not there (at most statsWindow checks)
+    for (int i = 0; i < this -> stats.recentCount; i++)
+        if (this -> stats.recentKeys[this -> recentSlot(i)].id == id)
+            return i;
+    return -1;
+}
+
+void Wallet::dropRecent(int position){
+    // removes a deleted tx from the rolling window, the older ones move up a slot
+    // and the freed oldest slot is refilled with the previous mined outgoing tx of the history (if there is one)
+    HistoryKey oldest = this -> stats.recentKeys[this -> recentSlot(0)];
+    this -> stats.recentSum -= this -> stats.recentSent[this -> recentSlot(position)];
+    for (int i = position; i > 0; i--){
+        this -> stats.recentSent[this -> recentSlot(i)] = this -> stats.recentSent[this -> recentSlot(i - 1)];
+        this -> stats.recentKeys[this -> recentSlot(i)] = this -> stats.recentKeys[this -> recentSlot(i - 1)];
     }
 
+    // a window that is not full already holds every mined outgoing tx
+    if (this -> stats.recentCount == statsWindow)
+        for (auto it = this -> history.lower_bound(oldest); it != this -> history.begin(); ){
+            it--;
+            if (it -> second -> getFrom() != this -> address)
+                continue;
+            this -> stats.recentSent[this -> recentSlot(0)] = it -> second -> getAmount();
+            this -> stats.recentKeys[this -> recentSlot(0)] = it -> first;
+            this -> stats.recentSum += it -> second -> getAmount();
+            return;
+        }
+    this -> stats.recentCount--;
+}
+
+void Wallet::updateAverageSpent(){
+    // updates the average spent by the user (also includes not mined txs), O(1) from the running totals
     // handle nan float case
-    if (aux == 0)
+    if (this -> stats.sentCount == 0)
         this -> setAverageSpent(0);
-    else this -> setAverageSpent(aux / ct);
+    else this -> setAverageSpent(float(this -> stats.totalSent) / this -> stats.sentCount);
+}
+
+// STATS
+Wallet::Stats::Stats():totalSent(0), totalReceived(0), sentCount(0), receivedCount(0), minSent(0), maxSent(0),
+                       recentCount(0), recentNext(0), recentSum(0) {}
+
+float Wallet::Stats::getRecentAverage() const{
+    // mean of the last statsWindow mined outgoing amounts
+    if (this -> recentCount == 0)
+        return 0;
+    return float(this -> recentSum) / this -> recentCount;
+}
+
+// ----------------- MERKLE TREE -----------------
+
+class MerkleTree{
+    // merkle tree over the hashes of the transactions of a block, built incrementally
+    // every level is kept, so appending a leaf only recalculates the nodes on its path to the root (O(log n))
+    // a node without a sibling (last node of a level with an odd size) is carried up unchanged
+    vector<vector<Hash>> levels;    // levels[0] are the leaves, the last level holds the root
+
+    static Hash combine(const Hash &left, const Hash &right);
+
+    public:
+        struct ProofStep{
+            Hash sibling;
+            bool siblingOnLeft;
+        };
+        typedef vector<ProofStep> Proof;
+
+        // CONSTRUCTORS
+        MerkleTree();
+
+        // utility functions
+        void append(const Hash &leaf);
+        void clear();
+        bool getProof(int index, Proof &proof) const;
+        static bool verifyProof(const Hash &leaf, const Proof &proof, const Hash &root);
+
+        // GETTERS
+        Hash getRoot() const;
+        int getSize() const;
+};
+
+// CONSTRUCTORS
+MerkleTree::MerkleTree(){}
+
+// GETTERS
+Hash MerkleTree::getRoot() const{
+    // the root of an empty tree is the unset hash
+    if (this -> levels.empty())
+        return Hash();
+    return this -> levels.back()[0];
+}
+
+int MerkleTree::getSize() const{
+    if (this -> levels.empty())
+        return 0;
+    return this -> levels[0].size();
+}
+
+// utility functions
+Hash MerkleTree::combine(const Hash &left, const Hash &right){
+    // the first word separates inner nodes from leaves (leaves are transaction hashes)
+    Hasher hasher;
+    hasher.updateWord(1);
+    hasher.updateWord(left.getValue());
+    hasher.updateWord(right.getValue());
+    return Hash(hasher.final());
+}
+
+void MerkleTree::append(const Hash &leaf){
+    if (this -> levels.empty())
+        this -> levels.push_back(vector<Hash>());
+    this -> levels[0].push_back(leaf);
+
+    // walk up from the new leaf, only its ancestors change
+    size_t index = this -> levels[0].size() - 1;
+    for (size_t k = 0; this -> levels[k].size() > 1; k++){
+        if (k + 1 == this -> levels.size())
+            this -> levels.push_back(vector<Hash>());
+
+        const vector<Hash> &level = this -> levels[k];
+        size_t left = index & ~size_t(1);
+        Hash parent = left + 1 < level.size() ? combine(level[left], level[left + 1]) : level[left];
+
+        index /= 2;
+        if (index < this -> levels[k + 1].size())
+            this -> levels[k + 1][index] = parent;
+        else this -> levels[k + 1].push_back(parent);
+    }
+}
+
+void MerkleTree::clear(){
+    this -> levels.clear();
+}
+
+bool MerkleTree::getProof(int index, Proof &proof) const{
+    // collects the siblings on the path from a leaf to the root
+    proof.clear();
+    if (index < 0 || index >= this -> getSize())
+        return false;
+
+    size_t position = index;
+    for (size_t k = 0; k + 1 < this -> levels.size(); k++){
+        size_t sibling = position ^ 1;
+        if (sibling < this -> levels[k].size())
+            proof.push_back({this -> levels[k][sibling], sibling < position});
+        position /= 2;
+    }
+    return true;
+}
+
+bool MerkleTree::verifyProof(const Hash &leaf, const Proof &proof, const Hash &root){
+    // only needs the transaction hash, the proof and the root (no other transaction of the block)
+    Hash node = leaf;
+    for (auto it = proof.begin(); it != proof.end(); it++)
+        node = (*it).siblingOnLeft ? combine((*it).sibling, node) : combine(node, (*it).sibling);
+    return node == root;
 }
 
 // ----------------- BLOCK -----------------
@@ -1240,7 +2839,10 @@ class Block{
     string hash;                      // hash of the other fields (id of block)
     string parentHash;                // hash of the previous block
     int height;                       // height of the block in the blockchain
-    list<Transaction> transactions;   // list of transactions included in the block
+    vector<TxRef> transactions;       // transactions included in the block (shared with the mempool and wallets)
+    MerkleTree merkleTree;            // merkle tree over the hashes of the transactions
+
+    void rebuildMerkleTree();
 
     public:
         // CONSTRUCTORS
@@ -1249,17 +2851,22 @@ class Block{
         Block(string parentHash, int height, list<Transaction> transactions);
         Block(string hash, string parentHash, int height, list<Transaction> transactions);
         Block(const Block &obj);
+        Block(Block &&obj) noexcept;
 
         // utility functions
         string calculateHash();
         void updateHash();
         void addTx(const Transaction &tx);
+        void addTx(const TxRef &tx);
+        void markMined();
+        bool getProof(const Hash &txHash, MerkleTree::Proof &proof) const;
 
         // OPERATORS
         Block& operator=(const Block&);
+        Block& operator=(Block&&) noexcept;
         Block operator+(const Transaction&);
         Block operator+(const Block&);
-        Transaction operator[](string);
+        Transaction operator[](const Hash&);
         Block& operator--();
         Block operator--(int);
         Block operator-(const Transaction&);
@@ -1272,7 +2879,8 @@ class Block{
         string getHash() const;
         string getParentHash() const;
         int getHeight() const;
-        const list<Transaction>& getTransactions() const;
+        const vector<TxRef>& getTransactions() const;
+        Hash getMerkleRoot() const;
 
         // SETTERS
         void setHash(string);
@@ -1301,14 +2909,18 @@ Block::Block(string parentHash, int height, list<Transaction> transactions){
 }
 
 Block::Block(string hash, string parentHash, int height, list<Transaction> transactions){
-    this -> setHash(hash);
+    // the hash is checked against the other fields, so it is set last
     this -> setParentHash(parentHash);
     this -> setHeight(height);
     this -> setTransactions(transactions);
+    this -> setHash(hash);
 }
 
 Block::Block(const Block &obj):hash(obj.hash), parentHash(obj.parentHash), height(obj.height), 
-                               transactions(obj.transactions) {}
+                               transactions(obj.transactions), merkleTree(obj.merkleTree) {}
+
+Block::Block(Block &&obj) noexcept:hash(move(obj.hash)), parentHash(move(obj.parentHash)), height(obj.height),
+                                   transactions(move(obj.transactions)), merkleTree(move(obj.merkleTree)) {}
 
 // GETTERS
 string Block::getHash() const{
@@ -1323,10 +2935,14 @@ int Block::getHeight() const{
     return this -> height;
 }
 
-const list<Transaction>& Block::getTransactions() const{
+const vector<TxRef>& Block::getTransactions() const{
     return this -> transactions;
 }
 
+Hash Block::getMerkleRoot() const{
+    return this -> merkleTree.getRoot();
+}
+
 // SETTERS
 void Block::setHash(string hash){
     if (!isProperHex(hash.substr(2))){
@@ -1361,12 +2977,16 @@ void Block::setHeight(int height){
 }
 
 void Block::setTransactions(list<Transaction> transactions){
-    this -> transactions = transactions;
+    this -> transactions.clear();
+    this -> transactions.reserve(transactions.size());
+    for (auto it = transactions.begin(); it != transactions.end(); it++)
+        this -> transactions.push_back(TxRef(*it));
+    this -> rebuildMerkleTree();
 }
 
 // DESTRUCTOR
 Block::~Block(){
-    // no dynamic memory allocated
+    // the handles release the pooled transactions by themselves
 }
 
 // OPERATORS
@@ -1412,6 +3032,8 @@ ostream& operator<<(ostream &out, const Block &obj){
     out << ANSI_COLOR_GREEN << "+-+-+ BLOCK " << obj.getHeight() << " +-+-+\n" << ANSI_COLOR_RESET;
     out << "Hash: " << obj.getHash() << endl;
     out << "Parent Hash: " << obj.getParentHash() << endl;
+    if (!obj.getTransactions().empty())
+        out << "Merkle Root: " << obj.getMerkleRoot() << endl;
 
     if (obj.getTransactions().empty()){
         out << "The block has no transactions.\n";
@@ -1420,7 +3042,7 @@ ostream& operator<<(ostream &out, const Block &obj){
     out << "Transactions in the block: " << endl << endl;
     int i = 0;
     for (auto it = obj.getTransactions().begin(); it != obj.getTransactions().end(); it++)
-        out << *it << endl;
+        out << **it << endl;
     return out;
 }
 
@@ -1432,6 +3054,20 @@ Block& Block::operator=(const Block &obj){
     this -> parentHash = obj.parentHash;
     this -> height = obj.height;
     this -> transactions = obj.transactions;
+    this -> merkleTree = obj.merkleTree;
+
+    return *this;
+}
+
+Block& Block::operator=(Block &&obj) noexcept{
+    if (this == &obj)
+        return *this;
+
+    this -> hash = move(obj.hash);
+    this -> parentHash = move(obj.parentHash);
+    this -> height = obj.height;
+    this -> transactions = move(obj.transactions);
+    this -> merkleTree = move(obj.merkleTree);
 
     return *this;
 }
@@ -1455,8 +3091,9 @@ Block Block::operator-(const Transaction &tx){
     // removes a transaction from the block
     Block newBlock = *this;
     for (auto it = newBlock.transactions.begin(); it != newBlock.transactions.end(); it++){
-        if ((*it) == tx){
+        if ((*it) -> getHash() == tx.getHash()){
             newBlock.transactions.erase(it);
+            newBlock.rebuildMerkleTree();
             newBlock.updateHash();
             return newBlock;
         }
@@ -1472,10 +3109,10 @@ Block Block::operator+(const Block &block){
     return newBlock;
 }
 
-Transaction Block::operator[](string hash){
+Transaction Block::operator[](const Hash &hash){
     for (auto it = this -> transactions.begin(); it != this -> transactions.end(); it++)
-        if ((*it).getHash() == hash)
-            return *it;
+        if ((*it) -> getHash() == hash)
+            return **it;
     sysMessage("The transaction with the hash provided was not found in the block.");
     return Transaction();
 }
@@ -1487,6 +3124,7 @@ Block& Block::operator--(){
         return *this;
     }
     this -> transactions.pop_back();
+    this -> rebuildMerkleTree();
     this -> updateHash();
     return *this;
 }
@@ -1513,674 +3151,3813 @@ bool Block::operator==(const Block &obj){
 }
 
 Block::operator list<Transaction>() const{
-    return this -> transactions;
+    list<Transaction> txs;
+    for (auto it = this -> transactions.begin(); it != this -> transactions.end(); it++)
+        txs.push_back(**it);
+    return txs;
 }
 
 // utility functions
 string Block::calculateHash(){
     // calculates a hash based on all fields of the block
-    unsigned long long hashVal = 0;
-
-    for (int i = 0; i < this -> parentHash.length(); i++){
-        hashFunc(hashVal, int(parentHash[i]));
-    }
-    hashFunc(hashVal, height);
-
-    // we consider the hashes of the transactions for the block hash
-    for (auto it = this -> transactions.begin(); it != this -> transactions.end(); it++){
-        for (int i = 0; i < (*it).getHash().length(); i++)
-            hashFunc(hashVal, int((*it).getHash()[i]));
+    Hasher hasher;
+    hasher.update(this -> parentHash.data(), this -> parentHash.length());
+    hasher.updateWord(height);
+
+    // v1 hashes every transaction hash in its hex form, so changing the block costs O(n)
+    if (hasher.getVersion() == HASH_V1){
+        char txHash[19];
+        for (auto it = this -> transactions.begin(); it != this -> transactions.end(); it++)
+            hasher.update(txHash, (*it) -> getHash().writeHex(txHash));
+        return Hash(hasher.final()).toHex();
     }
 
-    stringstream ss;
-    ss << hex << hashVal;
-    return "0x" + ss.str();
+    // newer versions commit to the transactions through the merkle root
+    hasher.updateWord(this -> merkleTree.getRoot().getValue());
+    return Hash(hasher.final()).toHex();
 }
 
 void Block::updateHash(){
     this -> hash = this -> calculateHash();
 }
 
+void Block::rebuildMerkleTree(){
+    // used when transactions are removed or replaced
+    this -> merkleTree.clear();
+    for (auto it = this -> transactions.begin(); it != this -> transactions.end(); it++)
+        this -> merkleTree.append((*it) -> getHash());
+}
+
 void Block::addTx(const Transaction &tx){
     // adds a transaction to the block
     if (!tx.isMineable()){
         sysMessage("The transaction is not mineable. It will not be added to the block.");
         return;
     }
-    this -> transactions.push_back(tx);
+    this -> transactions.push_back(TxRef(tx));
+    this -> merkleTree.append(tx.getHash());
     this -> updateHash();
 }
 
-// ----------------- BLOCKCHAIN -----------------
+void Block::markMined(){
+    // the block gets its own mined copies of the transactions, whoever shared the old handles still sees them pending
+    // (the hashes don't include the flag, so the merkle tree and the hash of the block stay the same)
+    for (auto it = this -> transactions.begin(); it != this -> transactions.end(); it++)
+        *it = it -> minedCopy();
+}
 
-class Blockchain{
-    int currentHeight;                      // height of the last block mined
-    char *currentHash;                      // hash of the last block mined
-    Mempool mempool;                        // mempory pool of transactions
-    list<Block> blocks;                     // list of blocks proccessed
-    unordered_map<string, Wallet> wallets;  // map of wallets (address -> wallet)
-    char status;                            // status of the blockchain (I - initializing, A - active)
+void Block::addTx(const TxRef &tx){
+    // adds an already pooled transaction to the block, the transaction is shared and not copied
+    if (tx.isNull() || !tx -> isMineable()){
+        sysMessage("The transaction is not mineable. It will not be added to the block.");
+        return;
+    }
+    this -> transactions.push_back(tx);
+    this -> merkleTree.append(tx -> getHash());
+    this -> updateHash();
+}
 
-    // statistics variables
-    float *txStats;                          // array of average coins transacted per block
-    double averageTransacted;                // average amount of coins transacted in all blocks
+bool Block::getProof(const Hash &txHash, MerkleTree::Proof &proof) const{
+    // inclusion proof of a transaction, it can be checked against the merkle root with MerkleTree::verifyProof
+    int index = 0;
+    for (auto it = this -> transactions.begin(); it != this -> transactions.end(); it++, index++)
+        if ((*it) -> getHash() == txHash)
+            return this -> merkleTree.getProof(index, proof);
+    proof.clear();
+    return false;
+}
+
+// ----------------- BLOCK LOG -----------------
+
+class BlockLog{
+    // append-only file with the blocks of the chain in a compact binary encoding
+    // file: header (magic, format version, hash version) followed by records (4 byte payload length + payload)
+    // payload: hash, parent hash, height, transactions (addresses as 20 bytes, numbers as varints)
+    // the records are indexed by height and by hash when the log is opened, reads go through a memory mapping
+    static const char magic[6];
+    static const int formatVersion = 1;
+    static const int headerSize = 8;
+
+    string path;
+    FILE *file;                             // used for appending
+    const unsigned char *data;              // read only mapping of the file
+    size_t mappedSize;
+    size_t fileSize;                        // size of the valid part of the file
+    int firstHeight;                        // height of the first block in the log
+    vector<size_t> offsets;                 // offset of the record of height firstHeight + i
+    unordered_map<string, int> hashIndex;   // hash of block -> index in offsets
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+
+    bool mapFile();
+    void unmapFile();
+    bool readRecord(int index, Block &bl);
+    static void putVarint(string &out, unsigned int value);
+    static bool getVarint(const unsigned char *&in, const unsigned char *end, unsigned int &value);
+    static void putString(string &out, const string &value);
+    static bool getString(const unsigned char *&in, const unsigned char *end, string &value);
 
     public:
         // CONSTRUCTORS
-        Blockchain();
-        Blockchain(int currentHeight, char *currentHash, unordered_map<string, Wallet> wallets);
-        Blockchain(int currentHeight, char *currentHash, list<Block> blocks, unordered_map<string, Wallet> wallets);
-        Blockchain(int currentHeight, char *currentHash, Mempool mempool, list<Block> blocks, 
-                   unordered_map<string, Wallet> wallets, char status, float *txStats, double averageTransacted);
-        Blockchain(const Blockchain &obj);
+        BlockLog();
+        BlockLog(const BlockLog&) = delete;
 
         // utility functions
-        bool validateTx(Transaction&, unordered_map<string, Wallet>&);
-        bool validateBlockTransactions(Block&);
-        void processBlock(Block&);
-        void applyBlockOnState(Block&);
-        void updateStatistics(Block&);
-        void generateGenesis();
-        void sendTx(Transaction&);
-        Block proposeBlock();
-        int getAccountNonce(string);
-        Transaction readTx();
-        void cleanMempool();
-        void cleanWallets();
+        bool open(const string &path);
+        void close();
+        bool append(const Block &bl);
+        bool readByHeight(int height, Block &bl);
+        bool readByHash(const string &hash, Block &bl);
+        static void encode(const Block &bl, string &out);
+        static bool decode(const unsigned char *in, size_t size, Block &bl);
 
         // OPERATORS
-        friend istream& operator>>(istream&, Blockchain&);
-        Blockchain& operator=(const Blockchain&);
-        Transaction operator[](string);
-        Blockchain& operator--();
-        Blockchain operator--(int);
-        Blockchain operator+(Block);
-        Blockchain operator-(const Transaction&);
-        bool operator<(const Blockchain&) const;
-        bool operator>(const Blockchain&);
-        bool operator==(const Blockchain&);
-        operator string() const;
+        BlockLog& operator=(const BlockLog&) = delete;
 
         // GETTERS
-        int getCurrentHeight() const;
-        const char* getCurrentHash() const;
-        const Mempool& getMempool() const;
-        const list<Block>& getBlocks() const;
-        const unordered_map<string, Wallet>& getWallets() const;
-        char getStatus() const;
-        const float* getTxStats() const;
-        double getAverageTransacted() const;
-
-        // SETTERS
-        void setCurrentHeight(int);
-        void setCurrentHash(char*);
-        void setStatus(char);
-        void setMempool(Mempool);
-        void setTxStats(float*);
-        void setAverageTransacted(double);
-        void setBlocks(list<Block>&);
+        bool isOpen() const;
+        const string& getPath() const;
+        int getSize() const;
+        int getFirstHeight() const;
+        int getLastHeight() const;
 
         // DESTRUCTOR
-        ~Blockchain();
+        ~BlockLog();
 };
 
- // CONSTRUCTORS
-Blockchain::Blockchain():currentHeight(0), currentHash(NULL), status('I'), txStats(NULL), averageTransacted(0) {}
+const char BlockLog::magic[6] = {'B', 'L', 'K', 'L', 'O', 'G'};
 
-Blockchain::Blockchain(int currentHeight, char *currentHash, 
-                       unordered_map<string, Wallet> wallets):txStats(NULL), averageTransacted(0), status('A'){
-    this -> setCurrentHeight(currentHeight);
-    this -> setCurrentHash(currentHash);
-    this -> wallets = wallets;
+// CONSTRUCTORS
+BlockLog::BlockLog():file(NULL), data(NULL), mappedSize(0), fileSize(0), firstHeight(0){
+#ifdef _WIN32
+    this -> mapping = NULL;
+#endif
 }
 
-Blockchain::Blockchain(int currentHeight, char *currentHash, list<Block> blocks, 
-                       unordered_map<string, Wallet> wallets):status('A'), txStats(NULL), averageTransacted(0){
-    this -> setCurrentHeight(currentHeight);
-    this -> setCurrentHash(currentHash);
-    this -> blocks.clear();
-    this -> wallets.clear();
-    this -> wallets = wallets;
-    this -> setBlocks(blocks);
+// GETTERS
+bool BlockLog::isOpen() const{
+    return this -> file != NULL;
 }
 
-Blockchain::Blockchain(int currentHeight, char *currentHash, Mempool mempool, list<Block> blocks, 
-            unordered_map<string, Wallet> wallets, char status, float *txStats, double averageTransacted){
-    this -> currentHeight = currentHeight;
-    this -> setCurrentHash(currentHash);
-    this -> mempool = mempool;
-    this -> blocks = blocks;
-    this -> wallets = wallets;
-    this -> status = status;
-    this -> setTxStats(txStats);
-    this -> averageTransacted = averageTransacted;
+const string& BlockLog::getPath() const{
+    return this -> path;
 }
 
-Blockchain::Blockchain(const Blockchain &obj):currentHeight(obj.currentHeight), 
-                                              mempool(obj.mempool), blocks(obj.blocks), wallets(obj.wallets), 
-                                              status(obj.status), averageTransacted(obj.averageTransacted)
-{
-    this -> setCurrentHash(obj.currentHash);
-    this -> setTxStats(obj.txStats);
+int BlockLog::getSize() const{
+    return this -> offsets.size();
 }
 
-// GETTERS
-int Blockchain::getCurrentHeight() const{
-    return this -> currentHeight;
+int BlockLog::getFirstHeight() const{
+    return this -> firstHeight;
 }
 
-const char* Blockchain::getCurrentHash() const{
-    return this -> currentHash;
+int BlockLog::getLastHeight() const{
+    // -1 if the log is empty
+    if (this -> offsets.empty())
+        return -1;
+    return this -> firstHeight + this -> offsets.size() - 1;
 }
 
-const Mempool& Blockchain::getMempool() const{
-    return this -> mempool;
+// utility functions
+void BlockLog::putVarint(string &out, unsigned int value){
+    // 7 bits per byte, the high bit marks that more bytes follow
+    while (value >= 0x80){
+        out += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
 }
 
-const list<Block>& Blockchain::getBlocks() const{
-    return this -> blocks;
+bool BlockLog::getVarint(const unsigned char *&in, const unsigned char *end, unsigned int &value){
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7){
+        if (in == end)
+            return false;
+        unsigned char byte = *in++;
+        value |= (unsigned int)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
 }
 
-const unordered_map<string, Wallet>& Blockchain::getWallets() const{
-    return this -> wallets;
+void BlockLog::putString(string &out, const string &value){
+    putVarint(out, value.length());
+    out += value;
 }
 
-char Blockchain::getStatus() const{
-    return this -> status;
+bool BlockLog::getString(const unsigned char *&in, const unsigned char *end, string &value){
+    unsigned int length;
+    if (!getVarint(in, end, length) || length > size_t(end - in))
+        return false;
+    value.assign((const char*)in, length);
+    in += length;
+    return true;
 }
 
-const float* Blockchain::getTxStats() const{
-    return this -> txStats;
+void BlockLog::encode(const Block &bl, string &out){
+    // the hashes of the transactions are not stored, they are calculated again when the block is read
+    out.clear();
+    putString(out, bl.getHash());
+    putString(out, bl.getParentHash());
+    putVarint(out, bl.getHeight());
+    putVarint(out, bl.getTransactions().size());
+    for (auto it = bl.getTransactions().begin(); it != bl.getTransactions().end(); it++){
+        out.append((const char*)(*it) -> getFrom().getBytes(), 20);
+        out.append((const char*)(*it) -> getTo().getBytes(), 20);
+        putVarint(out, (*it) -> getAmount());
+        putVarint(out, (*it) -> getFee());
+        putVarint(out, (*it) -> getNonce());
+    }
 }
 
-double Blockchain::getAverageTransacted() const{
-    return this -> averageTransacted;
-}
+bool BlockLog::decode(const unsigned char *in, size_t size, Block &bl){
+    // rebuilds the block and checks it against the stored hash
+    // the fields are validated first, so a corrupted record is rejected instead of reaching the setters
+    auto isHash = [](const string &value){
+        return value.length() > 2 && value.compare(0, 2, "0x") == 0 && isProperHex(value.substr(2));
+    };
+    const unsigned char *end = in + size;
+    string hash, parentHash;
+    unsigned int height, count;
+    if (!getString(in, end, hash) || !getString(in, end, parentHash) || !getVarint(in, end, height) || !getVarint(in, end, count))
+        return false;
+    if (!isHash(hash) || !isHash(parentHash) || height > INT_MAX || count > size_t(end - in) / 43)
+        return false;
 
-// SETTERS
-void Blockchain::setCurrentHeight(int currentHeight){
-    if (this -> currentHeight + 1 != currentHeight && this -> status == 'A'){
-        sysMessage("The height of the new block is not consistent with the current height. The height was not modified.");
-        return;
+    list<Transaction> transactions;
+    for (unsigned int i = 0; i < count; i++){
+        if (end - in < 40)
+            return false;
+        Address from(in), to(in + 20);
+        in += 40;
+        unsigned int amount, fee, nonce;
+        if (!getVarint(in, end, amount) || !getVarint(in, end, fee) || !getVarint(in, end, nonce) ||
+            amount > INT_MAX || fee > INT_MAX || nonce > INT_MAX)
+            return false;
+        transactions.push_back(Transaction(from, to, amount, fee, nonce, true));
     }
-    this -> currentHeight = currentHeight;
+
+    bl = Block(parentHash, height, transactions);
+    return bl.getHash() == hash;
 }
 
-void Blockchain::setCurrentHash(char *currentHash){
-    if (this -> currentHash)
-        delete[] this -> currentHash;
-    this -> currentHash = new char[strlen(currentHash) + 1];
-    strcpy(this -> currentHash, currentHash);
+bool BlockLog::mapFile(){
+    // maps the whole file (it is mapped again when it grows past the mapped part)
+    this -> unmapFile();
+    size_t size = filesystem::file_size(this -> path);
+    if (size == 0)
+        return true;
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(this -> path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    this -> mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(handle);
+    if (!this -> mapping)
+        return false;
+    this -> data = (const unsigned char*)MapViewOfFile(this -> mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!this -> data){
+        CloseHandle(this -> mapping);
+        this -> mapping = NULL;
+        return false;
+    }
+#else
+    int fd = ::open(this -> path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    void *view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);    // the mapping stays valid
+    if (view == MAP_FAILED)
+        return false;
+    this -> data = (const unsigned char*)view;
+#endif
+    this -> mappedSize = size;
+    return true;
 }
 
-void Blockchain::setStatus(char status){
-    if (status != 'A' && status != 'I'){
-        sysMessage("The status of the blockchain can only be A (active) or I (initializing). The status was not modified.");
+void BlockLog::unmapFile(){
+    if (!this -> data)
         return;
+#ifdef _WIN32
+    UnmapViewOfFile(this -> data);
+    CloseHandle(this -> mapping);
+    this -> mapping = NULL;
+#else
+    munmap((void*)this -> data, this -> mappedSize);
+#endif
+    this -> data = NULL;
+    this -> mappedSize = 0;
+}
+
+bool BlockLog::open(const string &path){
+    // opens (or creates) a log and indexes its records
+    // an incomplete record at the end (e.g. the program stopped while writing) is cut off
+    this -> close();
+    this -> path = path;
+
+    this -> file = fopen(path.c_str(), "r+b");
+    if (!this -> file){
+        this -> file = fopen(path.c_str(), "w+b");
+        if (!this -> file){
+            sysMessage("The block log " + path + " could not be opened.");
+            return false;
+        }
+        unsigned char header[headerSize];
+        memcpy(header, magic, 6);
+        header[6] = formatVersion;
+        header[7] = Hasher::getDefaultVersion();
+        fwrite(header, 1, headerSize, this -> file);
+        fflush(this -> file);
     }
-    if (this -> status == 'A'){
-        sysMessage("The blockchain is already active. It can no longer be modified.");
-        return;
+
+    size_t size = filesystem::file_size(path);
+    if (!this -> mapFile() || size < size_t(headerSize) || memcmp(this -> data, magic, 6) != 0 || this -> data[6] != formatVersion){
+        sysMessage("The file " + path + " is not a block log. It was not opened.");
+        this -> close();
+        return false;
     }
-    this -> status = status;
+    if (this -> data[7] != Hasher::getDefaultVersion()){
+        sysMessage("The block log " + path + " was written with another hash version. It was not opened.");
+        this -> close();
+        return false;
+    }
+
+    // index the records
+    size_t offset = headerSize;
+    while (offset + 4 <= size){
+        const unsigned char *record = this -> data + offset;
+        size_t length = record[0] | record[1] << 8 | record[2] << 16 | (size_t)record[3] << 24;
+        if (offset + 4 + length > size)
+            break;
+
+        const unsigned char *in = record + 4, *end = in + length;
+        string hash, parentHash;
+        unsigned int height;
+        if (!getString(in, end, hash) || !getString(in, end, parentHash) || !getVarint(in, end, height))
+            break;
+        if (this -> offsets.empty())
+            this -> firstHeight = height;
+        else if (int(height) != this -> getLastHeight() + 1)
+            break;
+
+        this -> hashIndex[hash] = this -> offsets.size();
+        this -> offsets.push_back(offset);
+        offset += 4 + length;
+    }
+
+    if (offset < size){
+        warning("The block log " + path + " ends with an incomplete or corrupted record. It was cut off.");
+        this -> unmapFile();
+        fclose(this -> file);
+        filesystem::resize_file(path, offset);
+        this -> file = fopen(path.c_str(), "r+b");
+        if (!this -> file || !this -> mapFile()){
+            sysMessage("The block log " + path + " could not be opened again.");
+            this -> close();
+            return false;
+        }
+    }
+    this -> fileSize = offset;
+    fseek(this -> file, 0, SEEK_END);
+    return true;
 }
 
-void Blockchain::setMempool(Mempool mempool){
-    this -> mempool = mempool;
+void BlockLog::close(){
+    this -> unmapFile();
+    if (this -> file)
+        fclose(this -> file);
+    this -> file = NULL;
+    this -> fileSize = 0;
+    this -> firstHeight = 0;
+    this -> offsets.clear();
+    this -> hashIndex.clear();
 }
 
-void Blockchain::setTxStats(float *txStats){
-    if (txStats == NULL){
-        this -> txStats = NULL;
-        return;
+bool BlockLog::append(const Block &bl){
+    // the log only grows by the next height
+    if (!this -> isOpen()){
+        sysMessage("The block log is not open. The block was not written.");
+        return false;
     }
+    if (!this -> offsets.empty() && bl.getHeight() != this -> getLastHeight() + 1){
+        sysMessage("The height of the block does not follow the last block in the log. The block was not written.");
+        return false;
+    }
+
+    string payload;
+    encode(bl, payload);
+    unsigned char length[4];
+    for (int i = 0; i < 4; i++)
+        length[i] = (unsigned int)payload.length() >> (8 * i);
+    if (fwrite(length, 1, 4, this -> file) != 4 || fwrite(payload.data(), 1, payload.length(), this -> file) != payload.length()){
+        // the part that was written is cut off, so the next record starts right after the last valid one
+        sysMessage("The block could not be written in the block log.");
+        fflush(this -> file);
+        this -> unmapFile();
+        error_code error;
+        filesystem::resize_file(this -> path, this -> fileSize, error);
+        fseek(this -> file, this -> fileSize, SEEK_SET);
+        return false;
+    }
+    fflush(this -> file);
 
-    if (this -> txStats)
-        delete[] this -> txStats;
-    this -> txStats = new float[this -> currentHeight];
-    for (int i = 0; i < this -> currentHeight; i++)
-        this -> txStats[i] = txStats[i];
+    if (this -> offsets.empty())
+        this -> firstHeight = bl.getHeight();
+    this -> hashIndex[bl.getHash()] = this -> offsets.size();
+    this -> offsets.push_back(this -> fileSize);
+    this -> fileSize += 4 + payload.length();
+    return true;
 }
 
-void Blockchain::setAverageTransacted(double averageTransacted){
-    if (averageTransacted < 0){
-        sysMessage("The average transacted can not be negative. The value was not modified.");
-        return;
+bool BlockLog::readRecord(int index, Block &bl){
+    size_t offset = this -> offsets[index];
+    size_t end = index + 1 < this -> getSize() ? this -> offsets[index + 1] : this -> fileSize;
+    if (end > this -> mappedSize && !this -> mapFile()){
+        sysMessage("The block log could not be mapped.");
+        return false;
     }
-    this -> averageTransacted = averageTransacted;
+    if (!decode(this -> data + offset + 4, end - offset - 4, bl)){
+        sysMessage("The block log contains a corrupted block at height " + to_string(this -> firstHeight + index) + ".");
+        return false;
+    }
+    return true;
 }
 
-void Blockchain::setBlocks(list<Block> &blocks){
-    // note: we don't delete old blocks!
-    for (auto it = blocks.begin(); it != blocks.end(); it++)
-        this -> processBlock(*it);
+bool BlockLog::readByHeight(int height, Block &bl){
+    if (height < this -> firstHeight || height > this -> getLastHeight())
+        return false;
+    return this -> readRecord(height - this -> firstHeight, bl);
+}
+
+bool BlockLog::readByHash(const string &hash, Block &bl){
+    auto it = this -> hashIndex.find(hash);
+    if (it == this -> hashIndex.end())
+        return false;
+    return this -> readRecord(it -> second, bl);
 }
 
 // DESTRUCTOR
-Blockchain::~Blockchain(){
-    if (currentHash)
-        delete[] currentHash;
-    if (txStats)
-        delete[] txStats;
+BlockLog::~BlockLog(){
+    this -> close();
 }
 
-// OPERATORS
-istream& operator>>(istream& in, Blockchain &obj){
-    if (obj.getStatus() == 'A'){
-        sysMessage("The blockchain is already active. It can not be modified like this.");
-        return in;
+// ----------------- ACCOUNT STORE -----------------
+
+class AccountStore{
+    // dense storage for the consensus state of the accounts (balance and nonce)
+    // accounts are kept in parallel arrays (struct of arrays) so scans over the state are cache friendly
+    // and they are found through a flat open addressing table (linear probing) keyed by the binary address
+    // the history of an account (txs, statistics) is not part of the state and is kept by the wallets
+    vector<Address> addresses;
+    vector<int> balances;
+    vector<int> nonces;
+    vector<int> table;          // slot -> index of the account in the arrays + 1 (0 is an empty slot)
+
+    int findSlot(const Address&) const;
+    void rehash(int);
+
+    public:
+        // CONSTRUCTORS
+        AccountStore();
+
+        // utility functions
+        int find(const Address&) const;
+        int insert(const Address&);
+        bool erase(const Address&);
+        bool contains(const Address&) const;
+        void reserve(int);
+        void clear();
+
+        // GETTERS
+        int getSize() const;
+        const Address& getAddress(int) const;
+        int getBalance(int) const;
+        int getNonce(int) const;
+
+        // SETTERS
+        void setBalance(int, int);
+        void setNonce(int, int);
+};
+
+// CONSTRUCTORS
+AccountStore::AccountStore():table(16, 0) {}
+
+// GETTERS
+int AccountStore::getSize() const{
+    return this -> addresses.size();
+}
+
+const Address& AccountStore::getAddress(int index) const{
+    return this -> addresses[index];
+}
+
+int AccountStore::getBalance(int index) const{
+    return this -> balances[index];
+}
+
+int AccountStore::getNonce(int index) const{
+    return this -> nonces[index];
+}
+
+// SETTERS
+void AccountStore::setBalance(int index, int balance){
+    if (balance < 0){
+        sysMessage("Balance can not be negative. Zero has been filled by default.");
+        balance = 0;
     }
-    int currentHeight;
-    string buffer;
-    unordered_map<string, Wallet> wallets;
-    char choice;
+    this -> balances[index] = balance;
+}
 
-    cout << "Enter the current height of the blockchain (how many blocks have been mined before): ";
-    in >> currentHeight;
-    if (currentHeight > 0){
-        // read current hash
-        cout << "Enter the hash of the last block (or leave blank for a random value): ";
-        buffer = new char[65];
-        in.ignore();
-        getline(in, buffer);
-        if (buffer == "")
-            buffer = generateRandomHex(); 
+void AccountStore::setNonce(int index, int nonce){
+    if (nonce < 0){
+        sysMessage("Nonce can not be negative. Zero has been filled by default.");
+        nonce = 0;
+    }
+    this -> nonces[index] = nonce;
+}
 
-        obj.setCurrentHeight(currentHeight);
+// utility functions
+int AccountStore::findSlot(const Address &addr) const{
+    // returns the slot holding the address or the empty slot where it would be inserted
+    int mask = this -> table.size() - 1;
+    int slot = addr.hashValue() & mask;
+    while (this -> table[slot] != 0 && this -> addresses[this -> table[slot] - 1] != addr)
+        slot = (slot + 1) & mask;
+    return slot;
+}
 
-        // read wallets
-        cout << "Do you want to add wallets? (Y/n): ";
-        in >> choice;
-        while (choice == 'Y' || choice == 'y'){
-            Wallet w;
-            in >> w;
-            wallets[w.getAddress()] = w;
-            cout << "Do you want to add another wallet? (Y/n): ";
-            in >> choice;
+void AccountStore::rehash(int capacity){
+    // capacity needs to be a power of 2
+    this -> table.assign(capacity, 0);
+    for (int i = 0; i < this -> getSize(); i++)
+        this -> table[this -> findSlot(this -> addresses[i])] = i + 1;
+}
+
+int AccountStore::find(const Address &addr) const{
+    // returns the index of the account or -1 if it does not exist
+    int slot = this -> findSlot(addr);
+    return this -> table[slot] - 1;
+}
+
+bool AccountStore::contains(const Address &addr) const{
+    return this -> find(addr) != -1;
+}
+
+int AccountStore::insert(const Address &addr){
+    // returns the index of the account, a new one (with no balance) is created if needed
+    int slot = this -> findSlot(addr);
+    if (this -> table[slot] != 0)
+        return this -> table[slot] - 1;
+
+    this -> addresses.push_back(addr);
+    this -> balances.push_back(0);
+    this -> nonces.push_back(0);
+    this -> table[slot] = this -> addresses.size();
+
+    // keep the table at most half full so probes stay short
+    if (this -> addresses.size() * 2 > this -> table.size())
+        this -> rehash(this -> table.size() * 2);
+    return this -> addresses.size() - 1;
+}
+
+bool AccountStore::erase(const Address &addr){
+    int slot = this -> findSlot(addr);
+    if (this -> table[slot] == 0)
+        return false;
+    int index = this -> table[slot] - 1;
+
+    // empty the slot and shift back the entries that were displaced by it (no tombstones needed)
+    int mask = this -> table.size() - 1;
+    int hole = slot;
+    for (int next = (hole + 1) & mask; this -> table[next] != 0; next = (next + 1) & mask){
+        int home = this -> addresses[this -> table[next] - 1].hashValue() & mask;
+        bool canMove = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+        if (canMove){
+            this -> table[hole] = this -> table[next];
+            hole = next;
         }
-        obj.wallets = wallets;
+    }
+    this -> table[hole] = 0;
+
+    // fill the gap in the arrays with the last account
+    int last = this -> addresses.size() - 1;
+    if (index != last){
+        this -> table[this -> findSlot(this -> addresses[last])] = index + 1;
+        this -> addresses[index] = this -> addresses[last];
+        this -> balances[index] = this -> balances[last];
+        this -> nonces[index] = this -> nonces[last];
+    }
+    this -> addresses.pop_back();
+    this -> balances.pop_back();
+    this -> nonces.pop_back();
+    return true;
+}
 
-        // consider no stats since we won't read blocks
-        obj.txStats = NULL;
-        obj.averageTransacted = 0;
-        if (obj.txStats)
-            delete[] obj.txStats;
-        obj.txStats = new float[currentHeight + 1];
-        for (int i = 1; i <= currentHeight; i++)
-            obj.txStats[i] = 0;
+void AccountStore::reserve(int accounts){
+    this -> addresses.reserve(accounts);
+    this -> balances.reserve(accounts);
+    this -> nonces.reserve(accounts);
+    int capacity = this -> table.size();
+    while (capacity < accounts * 2)
+        capacity *= 2;
+    if (capacity != int(this -> table.size()))
+        this -> rehash(capacity);
+}
 
-        // generate dummy block with the current hash provided (or randomly generated)
-        Block bl(buffer, currentHeight);
-        obj.blocks.push_back(bl);
+void AccountStore::clear(){
+    this -> addresses.clear();
+    this -> balances.clear();
+    this -> nonces.clear();
+    this -> table.assign(16, 0);
+}
 
-        // set the current hash from the dummy block
-        obj.setCurrentHash((char*)bl.getHash().c_str());
+// ----------------- STATE OVERLAY -----------------
 
-        // blocks will not be read, the mempool will be empty
-        // we can consider this blockchain as a truncated one, where it starts living based
-        // on the current state (formed of the current height, current hash, mempool and wallets)
-        // some blockchains utilize this feature since it allows deleting really old blocks
+class StateOverlay{
+    // a view of the accounts that records balance and nonce changes on top of the committed state
+    // instead of copying every account. the changes can be committed (written into the store) or discarded
+    // this is what the blockchain uses to simulate blocks, so the cost scales with the block and not with the network
+    // an overlay built on a const store is read only (it can still record changes, but not commit them)
+    struct AccountState{
+        int balance;
+        int nonce;
+    };
+
+    const AccountStore *committed;                  // the state the overlay is built on (not modified until commit)
+    AccountStore *writable;                         // the same store if the overlay can commit, NULL otherwise
+    unordered_map<Address, AccountState> changes;   // accounts touched through the overlay -> their current values
+
+    const AccountState* findChange(const Address&) const;
+
+    public:
+        // CONSTRUCTORS
+        StateOverlay(AccountStore &committed);
+        StateOverlay(const AccountStore &committed);
+
+        // utility functions
+        bool exists(const Address&) const;
+        void applyTx(const Transaction&);
+        void commit();
+        void discard();
+
+        // GETTERS
+        int getBalance(const Address&) const;
+        int getNonce(const Address&) const;
+        int getChangesCount() const;
+
+        // SETTERS
+        void setBalance(const Address&, int);
+        void setNonce(const Address&, int);
+};
+
+// CONSTRUCTORS
+StateOverlay::StateOverlay(AccountStore &committed):committed(&committed), writable(&committed) {}
+
+StateOverlay::StateOverlay(const AccountStore &committed):committed(&committed), writable(NULL) {}
+
+// GETTERS
+int StateOverlay::getBalance(const Address &addr) const{
+    const AccountState *change = this -> findChange(addr);
+    if (change)
+        return change -> balance;
+    int index = this -> committed -> find(addr);
+    return index == -1 ? 0 : this -> committed -> getBalance(index);
+}
+
+int StateOverlay::getNonce(const Address &addr) const{
+    const AccountState *change = this -> findChange(addr);
+    if (change)
+        return change -> nonce;
+    int index = this -> committed -> find(addr);
+    return index == -1 ? 0 : this -> committed -> getNonce(index);
+}
+
+int StateOverlay::getChangesCount() const{
+    return this -> changes.size();
+}
+
+// SETTERS
+void StateOverlay::setBalance(const Address &addr, int balance){
+    if (balance < 0){
+        sysMessage("Balance can not be negative. The overlay was not modified.");
+        return;
     }
-    else if (currentHeight == 0)
-        obj.generateGenesis();
-    else{
-        sysMessage("The height of the blockchain can not be negative. A fresh blockchain was generated.");
-        obj.generateGenesis();
+    int nonce = this -> getNonce(addr);
+    this -> changes[addr] = {balance, nonce};
+}
+
+void StateOverlay::setNonce(const Address &addr, int nonce){
+    if (nonce < 0){
+        sysMessage("Nonce can not be negative. The overlay was not modified.");
+        return;
     }
+    int balance = this -> getBalance(addr);
+    this -> changes[addr] = {balance, nonce};
+}
 
-    // set the status of the blockchain
-    obj.status = 'A';
+// utility functions
+const StateOverlay::AccountState* StateOverlay::findChange(const Address &addr) const{
+    auto it = this -> changes.find(addr);
+    if (it == this -> changes.end())
+        return NULL;
+    return &it -> second;
+}
 
-    return in;
+bool StateOverlay::exists(const Address &addr) const{
+    return this -> findChange(addr) || this -> committed -> contains(addr);
 }
 
-ostream& operator<<(ostream& out, const Blockchain &obj){
-    out << ANSI_COLOR_GREEN << "== BLOCKCHAIN ==\n" << ANSI_COLOR_RESET;
-    out << "Current height: " << obj.getCurrentHeight() << endl;
-    out << "Current hash: " << obj.getCurrentHash() << endl;
-    string status = obj.getStatus() == 'A' ? " (Active)" : " (Inactive)";
-    out << "Status: " << obj.getStatus() << status << endl;
-    out << "Average transacted: " << float(obj.getAverageTransacted()) / 100 << endl;
-    if (obj.getCurrentHeight() >= 3){
-        out << "The average for the last 3 blocks was: "
-            << float(obj.getTxStats()[obj.getCurrentHeight() - 2])  / 100 << " " 
-            << float (obj.getTxStats()[obj.getCurrentHeight() - 1]) / 100 << " " 
-            << float(obj.getTxStats()[obj.getCurrentHeight() - 0])  / 100 << endl;
+void StateOverlay::applyTx(const Transaction &tx){
+    // applies the balance and nonce changes of a (validated) transaction on the overlay
+    // same rules as applying a block: the sender pays amount + fee and its nonce is incremented
+    const Address &from = tx.getFrom(), &to = tx.getTo();
+    this -> setBalance(from, this -> getBalance(from) - tx.getAmount() - tx.getFee());
+    this -> setBalance(to, this -> getBalance(to) + tx.getAmount());
+    this -> setNonce(from, this -> getNonce(from) + 1);
+}
+
+void StateOverlay::commit(){
+    // writes the changes into the committed store (creating the accounts that don't exist yet)
+    if (!this -> writable){
+        sysMessage("The overlay is read only. The changes were not committed.");
+        return;
+    }
+    for (auto it = this -> changes.begin(); it != this -> changes.end(); it++){
+        int index = this -> writable -> insert(it -> first);
+        this -> writable -> setBalance(index, it -> second.balance);
+        this -> writable -> setNonce(index, it -> second.nonce);
     }
+    this -> changes.clear();
+}
+
+void StateOverlay::discard(){
+    this -> changes.clear();
+}
 
-    out << "There are " << obj.getWallets().size() << " wallets in the blockchain.\n";
+// ----------------- THREAD POOL -----------------
 
-    return out;
+class ThreadPool{
+    // fixed number of worker threads which take tasks from a shared queue
+    // used to spread the independent parts of the block validation over the cores
+    vector<thread> workers;
+    queue<function<void()>> tasks;
+    mutex lock;
+    condition_variable taskReady;       // signaled when a task is queued (or the pool is stopping)
+    condition_variable allDone;         // signaled when the last pending task finishes
+    int pending;                        // tasks queued or running
+    bool stopping;
+
+    void workerLoop();
+
+    public:
+        // CONSTRUCTORS
+        ThreadPool(int workers);
+        ThreadPool(const ThreadPool&) = delete;
+
+        // utility functions
+        void submit(function<void()> task);
+        void wait();
+        void parallelFor(int count, const function<void(int, int)> &body);
+
+        // OPERATORS
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // GETTERS
+        int getWorkers() const;
+
+        // DESTRUCTOR
+        ~ThreadPool();
+};
+
+// CONSTRUCTORS
+ThreadPool::ThreadPool(int workers):pending(0), stopping(false){
+    if (workers < 1){
+        sysMessage("A thread pool needs at least one worker. One worker was started.");
+        workers = 1;
+    }
+    for (int i = 0; i < workers; i++)
+        this -> workers.push_back(thread(&ThreadPool::workerLoop, this));
+}
+
+// GETTERS
+int ThreadPool::getWorkers() const{
+    return this -> workers.size();
+}
+
+// utility functions
+void ThreadPool::workerLoop(){
+    while (true){
+        function<void()> task;
+        {
+            unique_lock<mutex> guard(this -> lock);
+            this -> taskReady.wait(guard, [this]{ return this -> stopping || !this -> tasks.empty(); });
+            if (this -> tasks.empty())
+                return;     // stopping and nothing left to do
+            task = move(this -> tasks.front());
+            this -> tasks.pop();
+        }
+
+        task();
+
+        unique_lock<mutex> guard(this -> lock);
+        if (--this -> pending == 0)
+            this -> allDone.notify_all();
+    }
+}
+
+void ThreadPool::submit(function<void()> task){
+    {
+        unique_lock<mutex> guard(this -> lock);
+        this -> tasks.push(move(task));
+        this -> pending++;
+    }
+    this -> taskReady.notify_one();
+}
+
+void ThreadPool::wait(){
+    // blocks until every submitted task has finished
+    unique_lock<mutex> guard(this -> lock);
+    this -> allDone.wait(guard, [this]{ return this -> pending == 0; });
+}
+
+void ThreadPool::parallelFor(int count, const function<void(int, int)> &body){
+    // splits [0, count) into a few chunks per worker and runs body(begin, end) on each of them
+    if (count <= 0)
+        return;
+    int chunks = min(count, 4 * this -> getWorkers());
+    for (int i = 0; i < chunks; i++){
+        int begin = (long long)count * i / chunks, end = (long long)count * (i + 1) / chunks;
+        this -> submit([&body, begin, end]{ body(begin, end); });
+    }
+    this -> wait();
+}
+
+// DESTRUCTOR
+ThreadPool::~ThreadPool(){
+    {
+        unique_lock<mutex> guard(this -> lock);
+        this -> stopping = true;
+    }
+    this -> taskReady.notify_all();
+    for (auto it = this -> workers.begin(); it != this -> workers.end(); it++)
+        (*it).join();
+}
+
+// ----------------- BLOCK STATISTICS -----------------
+
+class BlockStats{
+    // per block statistics of the chain (the average amount of coins transacted in the txs of each block)
+    // a running sum gives the average of the whole chain and prefix sums the average of the last k blocks, both in O(1)
+    // by default every block is kept; with a retention limit only the last blocks are kept (in a ring buffer)
+    // and with downsampling every bucketSize blocks are also folded in one point, so long chains keep a coarse history
+    // (with a retention limit at most retention points, also in a ring buffer)
+    int firstHeight;            // height of the first recorded block
+    long long count;            // number of recorded blocks
+    double total;               // sum of the averages of all recorded blocks
+    int retention;              // number of blocks kept in detail (0 - all of them)
+    vector<float> values;       // averages of the kept blocks (a ring buffer once the retention is reached)
+    vector<double> prefix;      // prefix[i] - running total up to and including values[i]
+    int head;                   // slot of the oldest kept block
+    int bucketSize;             // blocks per downsampled point (0 - no downsampling)
+    vector<float> buckets;      // averages of the complete buckets (a ring buffer once the retention is reached)
+    int bucketHead;             // slot of the oldest bucket
+    double bucketSum;           // sum of the blocks of the incomplete bucket
+    int bucketFill;
+
+    int slot(int offset) const;
+
+    public:
+        // CONSTRUCTORS
+        BlockStats();
+        BlockStats(int retention, int bucketSize);
+
+        // utility functions
+        void add(float average);
+        void clear(int firstHeight);
+        bool has(int height) const;
+        float get(int height) const;
+        float getWindowAverage(int blocks) const;
+        void encode(string &out) const;
+        bool decode(const unsigned char *data, size_t length);
+
+        // GETTERS
+        double getAverage() const;
+        long long getCount() const;
+        int getFirstHeight() const;
+        int getLastHeight() const;
+        int getKept() const;
+        int getRetention() const;
+        int getBucketSize() const;
+        vector<float> getBuckets() const;
+
+        // SETTERS
+        void setRetention(int);
+        void setBucketSize(int);
+
+        // DESTRUCTOR
+        ~BlockStats();
+};
+
+// CONSTRUCTORS
+BlockStats::BlockStats():firstHeight(1), count(0), total(0), retention(0), head(0), bucketSize(0), bucketHead(0), bucketSum(0),
+                         bucketFill(0) {}
+
+BlockStats::BlockStats(int retention, int bucketSize):firstHeight(1), count(0), total(0), retention(0), head(0), bucketSize(0),
+                                                      bucketHead(0), bucketSum(0), bucketFill(0){
+    this -> setRetention(retention);
+    this -> setBucketSize(bucketSize);
+}
+
+// GETTERS
+double BlockStats::getAverage() const{
+    // average of all the recorded blocks (also the ones no longer kept)
+    if (this -> count == 0)
+        return 0;
+    return this -> total / this -> count;
+}
+
+long long BlockStats::getCount() const{
+    return this -> count;
+}
+
+int BlockStats::getFirstHeight() const{
+    return this -> firstHeight;
+}
+
+int BlockStats::getLastHeight() const{
+    // height of the last recorded block (firstHeight - 1 if nothing was recorded)
+    return this -> firstHeight + this -> count - 1;
+}
+
+int BlockStats::getKept() const{
+    return this -> values.size();
+}
+
+int BlockStats::getRetention() const{
+    return this -> retention;
+}
+
+int BlockStats::getBucketSize() const{
+    return this -> bucketSize;
+}
+
+vector<float> BlockStats::getBuckets() const{
+    // oldest first
+    vector<float> buckets(this -> buckets.size());
+    for (int i = 0; i < int(buckets.size()); i++)
+        buckets[i] = this -> buckets[(this -> bucketHead + i) % this -> buckets.size()];
+    return buckets;
+}
+
+// SETTERS
+void BlockStats::setRetention(int retention){
+    // the oldest kept blocks are dropped if the new limit is lower (the chain average is not affected)
+    if (retention < 0){
+        sysMessage("The retention of the block statistics can not be negative. All blocks will be kept.");
+        retention = 0;
+    }
+    int keep = this -> getKept();
+    if (retention > 0)
+        keep = min(keep, retention);
+
+    // lay the kept blocks out in order, starting with slot 0
+    vector<float> values(keep);
+    vector<double> prefix(keep);
+    for (int i = 0; i < keep; i++){
+        int from = this -> slot(this -> getKept() - keep + i);
+        values[i] = this -> values[from];
+        prefix[i] = this -> prefix[from];
+    }
+    this -> values = move(values);
+    this -> prefix = move(prefix);
+    this -> head = 0;
+
+    // the same for the downsampled points
+    vector<float> buckets = this -> getBuckets();
+    if (retention > 0 && int(buckets.size()) > retention)
+        buckets.erase(buckets.begin(), buckets.end() - retention);
+    this -> buckets = move(buckets);
+    this -> bucketHead = 0;
+    this -> retention = retention;
+}
+
+void BlockStats::setBucketSize(int bucketSize){
+    // downsampling starts over with the next block
+    if (bucketSize < 0){
+        sysMessage("The bucket size of the block statistics can not be negative. Downsampling was disabled.");
+        bucketSize = 0;
+    }
+    this -> bucketSize = bucketSize;
+    this -> buckets.clear();
+    this -> bucketHead = 0;
+    this -> bucketSum = 0;
+    this -> bucketFill = 0;
+}
+
+// DESTRUCTOR
+BlockStats::~BlockStats(){
+    // the vectors free themselves
+}
+
+// utility functions
+int BlockStats::slot(int offset) const{
+    // slot of the offset-th kept block (0 - the oldest one)
+    return (this -> head + offset) % this -> values.size();
+}
+
+void BlockStats::add(float average){
+    // records the next block, O(1) (amortized while the storage grows)
+    this -> total += average;
+    this -> count++;
+
+    if (this -> retention == 0 || this -> getKept() < this -> retention){
+        this -> values.push_back(average);
+        this -> prefix.push_back(this -> total);
+    }
+    else{
+        // the ring is full, the oldest block is overwritten
+        this -> values[this -> head] = average;
+        this -> prefix[this -> head] = this -> total;
+        this -> head = (this -> head + 1) % this -> retention;
+    }
+
+    if (this -> bucketSize > 0){
+        this -> bucketSum += average;
+        if (++this -> bucketFill == this -> bucketSize){
+            if (this -> retention == 0 || int(this -> buckets.size()) < this -> retention)
+                this -> buckets.push_back(this -> bucketSum / this -> bucketSize);
+            else{
+                this -> buckets[this -> bucketHead] = this -> bucketSum / this -> bucketSize;
+                this -> bucketHead = (this -> bucketHead + 1) % this -> retention;
+            }
+            this -> bucketSum = 0;
+            this -> bucketFill = 0;
+        }
+    }
+}
+
+void BlockStats::clear(int firstHeight){
+    // drops everything, the next recorded block will have the given height
+    this -> firstHeight = firstHeight;
+    this -> count = 0;
+    this -> total = 0;
+    this -> values.clear();
+    this -> prefix.clear();
+    this -> head = 0;
+    this -> buckets.clear();
+    this -> bucketHead = 0;
+    this -> bucketSum = 0;
+    this -> bucketFill = 0;
+}
+
+bool BlockStats::has(int height) const{
+    // true if the block at the given height is still kept
+    return height <= this -> getLastHeight() && height > this -> getLastHeight() - this -> getKept();
+}
+
+float BlockStats::get(int height) const{
+    if (!this -> has(height)){
+        sysMessage("There are no statistics for the block at height " + to_string(height) + ".");
+        return 0;
+    }
+    return this -> values[this -> slot(height - (this -> getLastHeight() - this -> getKept() + 1))];
+}
+
+float BlockStats::getWindowAverage(int blocks) const{
+    // average of the last blocks (limited to the kept ones), from the prefix sums
+    blocks = min(blocks, this -> getKept());
+    if (blocks <= 0)
+        return 0;
+    int last = this -> slot(this -> getKept() - 1);
+    int first = this -> slot(this -> getKept() - blocks);
+    double before = this -> prefix[first] - this -> values[first];
+    return (this -> prefix[last] - before) / blocks;
+}
+
+void BlockStats::encode(string &out) const{
+    // little endian, the kept blocks are written oldest first (the prefix sums are rebuilt when decoding)
+    auto putInt = [&out](unsigned int value){
+        for (int i = 0; i < 4; i++)
+            out += char(value >> (8 * i));
+    };
+    auto putLong = [&out](unsigned long long value){
+        for (int i = 0; i < 8; i++)
+            out += char(value >> (8 * i));
+    };
+    auto putDouble = [&putLong](double value){
+        unsigned long long bits;
+        memcpy(&bits, &value, 8);
+        putLong(bits);
+    };
+    auto putFloat = [&putInt](float value){
+        unsigned int bits;
+        memcpy(&bits, &value, 4);
+        putInt(bits);
+    };
+
+    putInt(this -> firstHeight);
+    putLong(this -> count);
+    putDouble(this -> total);
+    putInt(this -> retention);
+    putInt(this -> getKept());
+    for (int i = 0; i < this -> getKept(); i++)
+        putFloat(this -> values[this -> slot(i)]);
+    putInt(this -> bucketSize);
+    putInt(this -> bucketFill);
+    putDouble(this -> bucketSum);
+    vector<float> buckets = this -> getBuckets();
+    putInt(buckets.size());
+    for (auto it = buckets.begin(); it != buckets.end(); it++)
+        putFloat(*it);
+}
+
+bool BlockStats::decode(const unsigned char *data, size_t length){
+    // returns false (and leaves the statistics unchanged) if the data is not a valid encoding
+    size_t position = 0;
+    bool ok = true;
+    auto getInt = [&](){
+        if (!ok || position + 4 > length){
+            ok = false;
+            return 0u;
+        }
+        unsigned int value = data[position] | data[position + 1] << 8 | data[position + 2] << 16 | (unsigned int)data[position + 3] << 24;
+        position += 4;
+        return value;
+    };
+    auto getLong = [&](){
+        unsigned long long low = getInt();
+        return low | (unsigned long long)getInt() << 32;
+    };
+    auto getDouble = [&](){
+        unsigned long long bits = getLong();
+        double value;
+        memcpy(&value, &bits, 8);
+        return value;
+    };
+    auto getFloat = [&](){
+        unsigned int bits = getInt();
+        float value;
+        memcpy(&value, &bits, 4);
+        return value;
+    };
+
+    BlockStats stats;
+    stats.firstHeight = getInt();
+    stats.count = getLong();
+    stats.total = getDouble();
+    stats.retention = getInt();
+    unsigned int kept = getInt();
+    if (!ok || stats.retention < 0 || kept > stats.count || (stats.retention > 0 && kept > unsigned(stats.retention)) ||
+        kept > (length - position) / 4)
+        return false;
+
+    // the prefix sums are rebuilt backwards from the total
+    stats.values.resize(kept);
+    stats.prefix.resize(kept);
+    for (unsigned int i = 0; i < kept; i++)
+        stats.values[i] = getFloat();
+    double running = stats.total;
+    for (int i = int(kept) - 1; i >= 0; i--){
+        stats.prefix[i] = running;
+        running -= stats.values[i];
+    }
+
+    stats.bucketSize = getInt();
+    stats.bucketFill = getInt();
+    stats.bucketSum = getDouble();
+    unsigned int bucketCount = getInt();
+    if (!ok || stats.bucketSize < 0 || (stats.retention > 0 && bucketCount > unsigned(stats.retention)) ||
+        bucketCount > (length - position) / 4)
+        return false;
+    stats.buckets.resize(bucketCount);
+    for (unsigned int i = 0; i < bucketCount; i++)
+        stats.buckets[i] = getFloat();
+    if (!ok || position != length)
+        return false;
+
+    *this = move(stats);
+    return true;
+}
+
+// ----------------- BLOCKCHAIN -----------------
+
+// blocks smaller than this are validated on the calling thread (splitting them costs more than it saves)
+const int parallelValidationThreshold = 256;
+
+// in pipelined mode the history updates of sent transactions go to the block worker in batches of this size
+const int deferredHistoryBatch = 512;
+
+// retention policy of the wallets left without transactions: removed after the next block (0),
+// after this many blocks without new transactions (N > 0) or never (keepEmptyWallets)
+const int keepEmptyWallets = -1;
+
+int defaultValidationWorkers(){
+    // one worker per core (hardware_concurrency can return 0 if it can't tell)
+    return max(1u, thread::hardware_concurrency());
+}
+
+class Blockchain{
+    int currentHeight;                      // height of the last block mined
+    char *currentHash;                      // hash of the last block mined
+    Mempool mempool;                        // mempory pool of transactions
+    list<Block> blocks;                     // list of blocks proccessed
+    AccountStore accounts;                  // balances and nonces of all accounts (the state used for consensus)
+    unordered_map<Address, Wallet> wallets;  // map of wallets (address -> wallet), only used for the tx history of the accounts
+    bool trackHistory;                      // the wallets are optional, the blockchain works without them
+    unordered_map<Address, int> emptyWallets;   // wallets left without transactions -> height since when (checked by cleanWallets)
+    int walletRetention;                    // blocks an empty wallet is kept (0 - removed after the block, keepEmptyWallets - never)
+    char status;                            // status of the blockchain (I - initializing, A - active)
+    int validationWorkers;                  // number of threads used to validate blocks (1 - validate on the calling thread)
+    ThreadPool *validationPool;             // created the first time a block is large enough to be validated in parallel
+    bool pipelined;                         // the histories, statistics and wallet cleanup of a block are finished on blockWorker
+    ThreadPool *blockWorker;                // one thread, created the first time a block is processed in pipelined mode
+    vector<pair<bool, TxRef>> deferredHistory;  // history updates of the txs sent in pipelined mode (true - add, false - drop)
+    BlockLog blockLog;                      // blocks written on disk (optional), every processed block is appended
+    string snapshotPath;                    // where the state is saved every snapshotInterval blocks
+    int snapshotInterval;                   // 0 - no periodic snapshots
+
+    // statistics variables
+    BlockStats blockStats;                  // average coins transacted per block, with the average of the whole chain
+
+    public:
+        // CONSTRUCTORS
+        Blockchain();
+        Blockchain(int currentHeight, char *currentHash, unordered_map<Address, Wallet> wallets);
+        Blockchain(int currentHeight, char *currentHash, list<Block> blocks, unordered_map<Address, Wallet> wallets);
+        Blockchain(int currentHeight, char *currentHash, Mempool mempool, list<Block> blocks, 
+                   unordered_map<Address, Wallet> wallets, char status, const BlockStats &blockStats);
+        Blockchain(const Blockchain &obj);
+
+        // utility functions
+        bool validateTx(const Transaction&, const StateOverlay&);
+        bool validateBlockTransactions(Block&);
+        bool validateBlockTransactions(Block&, StateOverlay&);
+        bool validateBlockTransactionsParallel(Block&, StateOverlay&);
+        void processBlock(Block&);
+        void applyBlockOnState(Block&);
+        vector<int> applyBlockOnMempool(Block&);
+        void applyBlockOnHistories(Block&, const vector<int> &pendingIds);
+        void finishBlock(Block&, const vector<int> &pendingIds, const vector<TxRef> &evicted);
+        void flushPipeline();
+        void waitForBlockWorker() const;
+        void submitDeferredHistory();
+        void updateStatistics(Block&);
+        void generateGenesis();
+        void sendTx(Transaction&);
+        vector<char> sendTxBatch(const vector<Transaction>&);
+        Block proposeBlock();
+        int getAccountNonce(const Address&) const;
+        Transaction readTx();
+        void cleanMempool();
+        void cleanMempool(const Block&);
+        vector<TxRef> evictSuperseded(const Block&);
+        void cleanWallets();
+        void importWallets(const unordered_map<Address, Wallet>&);
+        Wallet& historyOf(const Address&);
+        void addToHistories(const TxRef&);
+        void dropFromHistories(const vector<TxRef>&);
+        void markIfEmpty(const Address&);
+        bool openBlockLog(const string&);
+        void closeBlockLog();
+        bool getBlock(int, Block&);
+        bool getBlock(const string&, Block&);
+        bool saveSnapshot(const string&) const;
+        bool loadSnapshot(const string&);
+        bool resume(const string &snapshotPath, const string &logPath);
+
+        // OPERATORS
+        friend istream& operator>>(istream&, Blockchain&);
+        Blockchain& operator=(const Blockchain&);
+        Transaction operator[](const Hash&);
+        Blockchain& operator--();
+        Blockchain operator--(int);
+        Blockchain operator+(Block);
+        Blockchain operator-(const Transaction&);
+        bool operator<(const Blockchain&) const;
+        bool operator>(const Blockchain&);
+        bool operator==(const Blockchain&);
+        operator string() const;
+
+        // GETTERS
+        int getCurrentHeight() const;
+        const char* getCurrentHash() const;
+        const Mempool& getMempool() const;
+        const list<Block>& getBlocks() const;
+        const unordered_map<Address, Wallet>& getWallets();
+        const AccountStore& getAccounts() const;
+        Wallet getWallet(const Address&);
+        bool getTrackHistory() const;
+        char getStatus() const;
+        int getValidationWorkers() const;
+        bool getPipelined() const;
+        int getWalletRetention() const;
+        const BlockStats& getBlockStats() const;
+        double getAverageTransacted() const;
+
+        // SETTERS
+        void setCurrentHeight(int);
+        void setCurrentHash(char*);
+        void setStatus(char);
+        void setMempool(Mempool);
+        void setBlockStats(const BlockStats&);
+        void setStatsRetention(int retention, int bucketSize);
+        void setBlocks(list<Block>&);
+        void setTrackHistory(bool);
+        void setValidationWorkers(int);
+        void setPipelined(bool);
+        void setWalletRetention(int);
+        void setSnapshots(const string &path, int interval);
+
+        // DESTRUCTOR
+        ~Blockchain();
+};
+
+ // CONSTRUCTORS
+Blockchain::Blockchain():currentHeight(0), currentHash(NULL), trackHistory(true), walletRetention(0), status('I'),
+                         validationWorkers(defaultValidationWorkers()), validationPool(NULL), pipelined(false), blockWorker(NULL), snapshotInterval(0) {}
+
+Blockchain::Blockchain(int currentHeight, char *currentHash, 
+                       unordered_map<Address, Wallet> wallets):currentHash(NULL), trackHistory(true), walletRetention(0), status('A'),
+                                                               validationWorkers(defaultValidationWorkers()), validationPool(NULL), pipelined(false), blockWorker(NULL),
+                                                               snapshotInterval(0){
+    this -> setCurrentHeight(currentHeight);
+    this -> setCurrentHash(currentHash);
+    this -> importWallets(wallets);
+}
+
+Blockchain::Blockchain(int currentHeight, char *currentHash, list<Block> blocks, 
+                       unordered_map<Address, Wallet> wallets):currentHash(NULL), trackHistory(true), walletRetention(0), status('A'),
+                                                               validationWorkers(defaultValidationWorkers()),
+                                                               validationPool(NULL), pipelined(false), blockWorker(NULL), snapshotInterval(0){
+    this -> setCurrentHeight(currentHeight);
+    this -> setCurrentHash(currentHash);
+    this -> blocks.clear();
+    this -> importWallets(wallets);
+    this -> setBlocks(blocks);
+}
+
+Blockchain::Blockchain(int currentHeight, char *currentHash, Mempool mempool, list<Block> blocks, 
+            unordered_map<Address, Wallet> wallets, char status, const BlockStats &blockStats):currentHash(NULL), trackHistory(true), walletRetention(0),
+                                                               validationWorkers(defaultValidationWorkers()), validationPool(NULL), pipelined(false), blockWorker(NULL),
+                                                               snapshotInterval(0), blockStats(blockStats){
+    this -> currentHeight = currentHeight;
+    this -> setCurrentHash(currentHash);
+    this -> mempool = mempool;
+    this -> blocks = blocks;
+    this -> importWallets(wallets);
+    this -> status = status;
+}
+
+Blockchain::Blockchain(const Blockchain &obj):Blockchain(){
+    // the members are copied by operator=, after obj's block worker is done (see waitForBlockWorker)
+    // the copy starts its own thread pools when it needs them (and doesn't share the block log or the snapshots)
+    *this = obj;
+}
+
+// GETTERS
+int Blockchain::getCurrentHeight() const{
+    return this -> currentHeight;
+}
+
+const char* Blockchain::getCurrentHash() const{
+    return this -> currentHash;
+}
+
+const Mempool& Blockchain::getMempool() const{
+    return this -> mempool;
+}
+
+const list<Block>& Blockchain::getBlocks() const{
+    return this -> blocks;
+}
+
+const unordered_map<Address, Wallet>& Blockchain::getWallets(){
+    this -> flushPipeline();
+    return this -> wallets;
+}
+
+const AccountStore& Blockchain::getAccounts() const{
+    return this -> accounts;
+}
+
+Wallet Blockchain::getWallet(const Address &addr){
+    // puts together the state of an account and its history (if it is tracked)
+    this -> flushPipeline();
+    int index = this -> accounts.find(addr);
+    int balance = index == -1 ? 0 : this -> accounts.getBalance(index);
+    int nonce = index == -1 ? 0 : this -> accounts.getNonce(index);
+
+    auto it = this -> wallets.find(addr);
+    if (it == this -> wallets.end())
+        return Wallet(addr, balance, nonce, Wallet::History(), 0);
+    return Wallet(addr, balance, nonce, it -> second.getHistory(), it -> second.getAverageSpent());
+}
+
+int Blockchain::getWalletRetention() const{
+    return this -> walletRetention;
+}
+
+bool Blockchain::getTrackHistory() const{
+    return this -> trackHistory;
+}
+
+int Blockchain::getValidationWorkers() const{
+    return this -> validationWorkers;
+}
+
+bool Blockchain::getPipelined() const{
+    return this -> pipelined;
+}
+
+char Blockchain::getStatus() const{
+    return this -> status;
+}
+
+const BlockStats& Blockchain::getBlockStats() const{
+    this -> waitForBlockWorker();
+    return this -> blockStats;
+}
+
+double Blockchain::getAverageTransacted() const{
+    this -> waitForBlockWorker();
+    return this -> blockStats.getAverage();
+}
+
+// SETTERS
+void Blockchain::setCurrentHeight(int currentHeight){
+    if (this -> currentHeight + 1 != currentHeight && this -> status == 'A'){
+        sysMessage("The height of the new block is not consistent with the current height. The height was not modified.");
+        return;
+    }
+    this -> currentHeight = currentHeight;
+}
+
+void Blockchain::setCurrentHash(char *currentHash){
+    if (this -> currentHash)
+        delete[] this -> currentHash;
+    this -> currentHash = new char[strlen(currentHash) + 1];
+    strcpy(this -> currentHash, currentHash);
+}
+
+void Blockchain::setStatus(char status){
+    if (status != 'A' && status != 'I'){
+        sysMessage("The status of the blockchain can only be A (active) or I (initializing). The status was not modified.");
+        return;
+    }
+    if (this -> status == 'A'){
+        sysMessage("The blockchain is already active. It can no longer be modified.");
+        return;
+    }
+    this -> status = status;
+}
+
+void Blockchain::setMempool(Mempool mempool){
+    this -> mempool = mempool;
+}
+
+void Blockchain::setBlockStats(const BlockStats &blockStats){
+    this -> flushPipeline();
+    if (blockStats.getCount() > 0 && blockStats.getLastHeight() != this -> currentHeight){
+        sysMessage("The block statistics do not end at the current height. They were not set.");
+        return;
+    }
+    this -> blockStats = blockStats;
+}
+
+void Blockchain::setStatsRetention(int retention, int bucketSize){
+    // how many blocks the statistics keep in detail (0 - all) and how many blocks make a downsampled point (0 - none)
+    this -> flushPipeline();
+    this -> blockStats.setRetention(retention);
+    this -> blockStats.setBucketSize(bucketSize);
+}
+
+void Blockchain::setValidationWorkers(int validationWorkers){
+    if (validationWorkers < 1){
+        sysMessage("At least one validation worker is needed. The number of workers was not modified.");
+        return;
+    }
+    if (validationWorkers == this -> validationWorkers)
+        return;
+    this -> validationWorkers = validationWorkers;
+
+    // the pool is started again with the new size when it is needed
+    if (this -> validationPool){
+        delete this -> validationPool;
+        this -> validationPool = NULL;
+    }
+}
+
+void Blockchain::setSnapshots(const string &path, int interval){
+    // saves the state in path every interval blocks (0 stops the snapshots)
+    if (interval < 0){
+        sysMessage("The snapshot interval can not be negative. The snapshots were not modified.");
+        return;
+    }
+    this -> flushPipeline();    // the block worker might be saving one
+    this -> snapshotPath = path;
+    this -> snapshotInterval = interval;
+}
+
+void Blockchain::setPipelined(bool pipelined){
+    // in pipelined mode processBlock returns once the state and the mempool are updated, the histories, statistics
+    // and wallet cleanup of the block are finished on a worker thread while the next block is prepared
+    this -> flushPipeline();
+    this -> pipelined = pipelined;
+}
+
+void Blockchain::setWalletRetention(int walletRetention){
+    // blocks an empty wallet is kept before it is removed (0 - after the next block, keepEmptyWallets - never)
+    if (walletRetention < keepEmptyWallets){
+        sysMessage("The wallet retention can not be less than " + to_string(keepEmptyWallets) + ". Default value (0) set.");
+        walletRetention = 0;
+    }
+    this -> flushPipeline();
+    if (walletRetention == keepEmptyWallets)
+        this -> emptyWallets.clear();
+    else if (this -> walletRetention == keepEmptyWallets)
+        // the empty wallets were not tracked until now
+        for (auto it = this -> wallets.begin(); it != this -> wallets.end(); it++)
+            if (it -> first != Transaction::getGodAddress() && it -> second.getHistory().empty())
+                this -> emptyWallets[it -> first] = this -> currentHeight;
+    this -> walletRetention = walletRetention;
+}
+
+void Blockchain::setTrackHistory(bool trackHistory){
+    // without history the blockchain only keeps the account state (much less memory for large networks)
+    this -> flushPipeline();
+    if (!trackHistory){
+        this -> wallets.clear();
+        this -> emptyWallets.clear();
+    }
+    else if (!this -> trackHistory)
+        warning("The history of the wallets was not tracked until now, older transactions will be missing.");
+    this -> trackHistory = trackHistory;
+}
+
+void Blockchain::setBlocks(list<Block> &blocks){
+    // note: we don't delete old blocks!
+    for (auto it = blocks.begin(); it != blocks.end(); it++)
+        this -> processBlock(*it);
+}
+
+// DESTRUCTOR
+Blockchain::~Blockchain(){
+    if (blockWorker)
+        delete blockWorker;     // runs the tasks left before it stops
+    if (currentHash)
+        delete[] currentHash;
+    if (validationPool)
+        delete validationPool;
+}
+
+// OPERATORS
+istream& operator>>(istream& in, Blockchain &obj){
+    if (obj.getStatus() == 'A'){
+        sysMessage("The blockchain is already active. It can not be modified like this.");
+        return in;
+    }
+    int currentHeight;
+    string buffer;
+    unordered_map<Address, Wallet> wallets;
+    char choice;
+
+    cout << "Enter the current height of the blockchain (how many blocks have been mined before): ";
+    in >> currentHeight;
+    if (currentHeight > 0){
+        // read current hash
+        cout << "Enter the hash of the last block (or leave blank for a random value): ";
+        buffer = new char[65];
+        in.ignore();
+        getline(in, buffer);
+        if (buffer == "")
+            buffer = generateRandomHex(); 
+
+        obj.setCurrentHeight(currentHeight);
+
+        // read wallets
+        cout << "Do you want to add wallets? (Y/n): ";
+        in >> choice;
+        while (choice == 'Y' || choice == 'y'){
+            Wallet w;
+            in >> w;
+            wallets[w.getAddress()] = w;
+            cout << "Do you want to add another wallet? (Y/n): ";
+            in >> choice;
+        }
+        obj.importWallets(wallets);
+
+        // consider no stats since we won't read blocks, they start with the next block
+        obj.blockStats.clear(currentHeight + 1);
+
+        // generate dummy block with the current hash provided (or randomly generated)
+        Block bl(buffer, currentHeight);
+        obj.blocks.push_back(bl);
+
+        // set the current hash from the dummy block
+        obj.setCurrentHash((char*)bl.getHash().c_str());
+
+        // blocks will not be read, the mempool will be empty
+        // we can consider this blockchain as a truncated one, where it starts living based
+        // on the current state (formed of the current height, current hash, mempool and wallets)
+        // some blockchains utilize this feature since it allows deleting really old blocks
+    }
+    else if (currentHeight == 0)
+        obj.generateGenesis();
+    else{
+        sysMessage("The height of the blockchain can not be negative. A fresh blockchain was generated.");
+        obj.generateGenesis();
+    }
+
+    // set the status of the blockchain
+    obj.status = 'A';
+
+    return in;
+}
+
+ostream& operator<<(ostream& out, const Blockchain &obj){
+    out << ANSI_COLOR_GREEN << "== BLOCKCHAIN ==\n" << ANSI_COLOR_RESET;
+    out << "Current height: " << obj.getCurrentHeight() << endl;
+    out << "Current hash: " << obj.getCurrentHash() << endl;
+    string status = obj.getStatus() == 'A' ? " (Active)" : " (Inactive)";
+    out << "Status: " << obj.getStatus() << status << endl;
+    out << "Average transacted: " << float(obj.getAverageTransacted()) / 100 << endl;
+    const BlockStats &stats = obj.getBlockStats();
+    if (obj.getCurrentHeight() >= 3 && stats.has(obj.getCurrentHeight() - 2)){
+        out << "The average for the last 3 blocks was: "
+            << stats.get(obj.getCurrentHeight() - 2) / 100 << " " 
+            << stats.get(obj.getCurrentHeight() - 1) / 100 << " " 
+            << stats.get(obj.getCurrentHeight() - 0) / 100 << endl;
+    }
+
+    out << "There are " << obj.getAccounts().getSize() << " wallets in the blockchain.\n";
+
+    return out;
+}
+
+Blockchain& Blockchain::operator=(const Blockchain &obj){
+    if (this == &obj)
+        return *this;
+
+    // the history updates obj has not handed to its block worker yet are copied and applied by this blockchain
+    this -> flushPipeline();
+    obj.waitForBlockWorker();
+    this -> currentHeight = obj.currentHeight;
+    this -> setCurrentHash(obj.currentHash);
+    this -> mempool = obj.mempool;
+    this -> blocks = obj.blocks;    // deep copy
+    this -> accounts = obj.accounts;
+    this -> wallets = obj.wallets;
+    this -> trackHistory = obj.trackHistory;
+    this -> emptyWallets = obj.emptyWallets;
+    this -> walletRetention = obj.walletRetention;
+    this -> status = obj.status;
+    this -> setValidationWorkers(obj.validationWorkers);
+    this -> pipelined = obj.pipelined;
+    this -> deferredHistory = obj.deferredHistory;
+    this -> blockStats = obj.blockStats;
+
+    return *this;
+}
+
+Transaction Blockchain::operator[](const Hash &hash){
+    // search for tx in the mempool (through its hash index)
+    const Transaction *pending = this -> mempool.getTx(hash);
+    if (pending)
+        return *pending;
+
+    // search for tx in blocks
+    for (auto it = this -> blocks.begin(); it != this -> blocks.end(); it++)
+        for (auto it2 = (*it).getTransactions().begin(); it2 != (*it).getTransactions().end(); it2++)
+            if ((*it2) -> getHash() == hash)
+                return **it2;
+
+    sysMessage("The transaction with the hash provided was not found in the blockchain.");
+    return Transaction();
+}
+
+Blockchain& Blockchain::operator--(){
+    // remove the last tx from the mempool
+    if (this -> mempool.getTxList().empty()){
+        sysMessage("The mempool is empty. No transactions to remove.");
+        return *this;
+    }
+    --(this -> mempool);
+    return *this;
+}
+
+Blockchain Blockchain::operator--(int){
+    // remove the last tx from the mempool
+    Blockchain copy = *this;
+    --(*this);
+    return copy;
+}
+
+Blockchain Blockchain::operator+(Block bl){
+    // process a block and add it to the blockchain
+    // not using const Block& due to conflict with processBlock function
+    Blockchain copy = *this;
+    copy.processBlock(bl);
+    return copy;
+}
+
+Blockchain Blockchain::operator-(const Transaction &tx){
+    // remove a transaction from the mempool
+    Blockchain copy = *this;
+    copy.mempool.deleteTx(tx.getHash());
+    return copy;
+}
+
+bool Blockchain::operator<(const Blockchain &obj) const{
+    // compare based on the height of the blockchain
+    return this -> currentHeight < obj.currentHeight;
+}
+
+bool Blockchain::operator>(const Blockchain &obj){
+    return obj < *this;
+}
+
+bool Blockchain::operator==(const Blockchain &obj){
+    // check if two blockchains are the same
+    
+    return this -> currentHeight ==  obj.currentHeight && 
+           strcmp(this -> currentHash, obj.currentHash) == 0 &&
+           this -> mempool       ==  obj.mempool;
+}
+
+Blockchain::operator string() const{
+    // returns the hash as a string
+    string aux = this -> currentHash;
+    return aux;
+}
+
+// utility functions
+bool Blockchain::validateTx(const Transaction &tx, const StateOverlay &state){
+    // checks if a transaction is valid (considering correct amounts and nonces)
+    if (!tx.isMineable())
+        return false;
+
+    // check if wallet exists
+    const Address &from = tx.getFrom();
+    if (!state.exists(from))
+        return false;
+
+    // check for overflow and verify if enough funds are available
+    if (tx.getAmount() + tx.getFee() < 0 || tx.getAmount() + tx.getFee() > state.getBalance(from))
+        return false;
+        
+    // check nonce
+    if (tx.getNonce() < state.getNonce(from) + 1 && tx.getNonce() != 0)
+        return false;
+    return true;
+}
+
+bool Blockchain::validateBlockTransactions(Block &bl){
+    // checks if the transactions from a block are valid (the simulated changes are discarded)
+    StateOverlay state(this -> accounts);
+    return this -> validateBlockTransactions(bl, state);
+}
+
+bool Blockchain::validateBlockTransactions(Block &bl, StateOverlay &state){
+    // checks if the transactions from a block are valid
+    // the balance and nonce updates are simulated on the overlay, which can be committed afterwards
+    if (this -> validationWorkers > 1 && int(bl.getTransactions().size()) >= parallelValidationThreshold)
+        return this -> validateBlockTransactionsParallel(bl, state);
+
+    for (auto it = bl.getTransactions().begin(); it != bl.getTransactions().end(); it++){
+        if (!validateTx(**it, state) || (*it) -> getNonce() != state.getNonce((*it) -> getFrom()) + 1)
+            return false;
+        state.applyTx(**it);
+    }
+    return true;
+}
+
+bool Blockchain::validateBlockTransactionsParallel(Block &bl, StateOverlay &state){
+    // same result as the serial validation, split in three passes:
+    // 1. checks that only look at the transaction (fields, addresses, hash), in parallel
+    // 2. nonces, in parallel per sender (a nonce only changes through the sender's own transactions)
+    // 3. balances, in block order on the calling thread (a sender can spend what it received earlier in the block)
+    if (!this -> validationPool)
+        this -> validationPool = new ThreadPool(this -> validationWorkers);
+
+    vector<const Transaction*> txs;
+    txs.reserve(bl.getTransactions().size());
+    for (auto it = bl.getTransactions().begin(); it != bl.getTransactions().end(); it++)
+        txs.push_back(it -> get());
+
+    // the block might come from somewhere else, so the hashes are recalculated even if they are cached
+    vector<char> valid(txs.size(), 1);
+    this -> validationPool -> parallelFor(txs.size(), [&txs, &valid](int begin, int end){
+        for (int i = begin; i < end; i++)
+            if (!txs[i] -> isMineable() || txs[i] -> getHash() != txs[i] -> calculateHash())
+                valid[i] = 0;
+    });
+    if (find(valid.begin(), valid.end(), 0) != valid.end())
+        return false;
+
+    // the transactions of each sender, in block order
+    unordered_map<Address, vector<const Transaction*>> bySender;
+    for (auto it = txs.begin(); it != txs.end(); it++)
+        bySender[(*it) -> getFrom()].push_back(*it);
+    vector<const pair<const Address, vector<const Transaction*>>*> senders;
+    senders.reserve(bySender.size());
+    for (auto it = bySender.begin(); it != bySender.end(); it++)
+        senders.push_back(&*it);
+
+    // the overlay is only read here, so the workers can share it
+    vector<char> validSender(senders.size(), 1);
+    this -> validationPool -> parallelFor(senders.size(), [&senders, &validSender, &state](int begin, int end){
+        for (int i = begin; i < end; i++){
+            int nonce = state.getNonce(senders[i] -> first);
+            for (auto it = senders[i] -> second.begin(); it != senders[i] -> second.end(); it++)
+                if ((*it) -> getNonce() != ++nonce){
+                    validSender[i] = 0;
+                    break;
+                }
+        }
+    });
+    if (find(validSender.begin(), validSender.end(), 0) != validSender.end())
+        return false;
+
+    for (auto it = txs.begin(); it != txs.end(); it++){
+        const Transaction &tx = **it;
+        if (!state.exists(tx.getFrom()))
+            return false;
+        if (tx.getAmount() + tx.getFee() < 0 || tx.getAmount() + tx.getFee() > state.getBalance(tx.getFrom()))
+            return false;
+        state.applyTx(tx);
+    }
+    return true;
+}
+
+bool Blockchain::openBlockLog(const string &path){
+    // attaches a block log to the blockchain
+    // blocks from the log that are newer than the chain are processed, blocks the log is missing are written in it
+    if (!this -> blockLog.open(path))
+        return false;
+    if (this -> status == 'I')
+        this -> generateGenesis();
+
+    // the log and the chain have to agree on the block at the height where they meet
+    int common = min(this -> currentHeight, this -> blockLog.getLastHeight());
+    if (this -> blockLog.getSize() > 0){
+        Block logged, own;
+        bool found = false;
+        for (auto it = this -> blocks.rbegin(); it != this -> blocks.rend() && !found; it++)
+            if ((*it).getHeight() == common){
+                own = *it;
+                found = true;
+            }
+        if (!found || !this -> blockLog.readByHeight(common, logged) || logged.getHash() != own.getHash()){
+            sysMessage("The block log " + path + " belongs to another chain. It was not attached.");
+            this -> blockLog.close();
+            return false;
+        }
+    }
+
+    // write the blocks the log is missing
+    for (auto it = this -> blocks.begin(); it != this -> blocks.end(); it++)
+        if ((*it).getHeight() > this -> blockLog.getLastHeight())
+            this -> blockLog.append(*it);
+
+    // replay the blocks the chain is missing
+    for (int height = this -> currentHeight + 1; height <= this -> blockLog.getLastHeight(); height++){
+        Block bl;
+        if (!this -> blockLog.readByHeight(height, bl))
+            return false;
+        this -> processBlock(bl);
+        if (this -> currentHeight != height){
+            sysMessage("The block at height " + to_string(height) + " from the log could not be processed. The replay was stopped.");
+            return false;
+        }
+    }
+    return true;
+}
+
+// snapshot file: magic, format version, hash version, then
+// height, current hash, last block (block log encoding),
+// accounts (all addresses, then all balances, then all nonces), block statistics (BlockStats encoding), checksum of everything before it
+const char snapshotMagic[6] = {'B', 'C', 'S', 'N', 'A', 'P'};
+const int snapshotVersion = 2;
+
+bool Blockchain::saveSnapshot(const string &path) const{
+    // the consensus state is saved, the tx histories and the mempool are not (like a truncated chain)
+    // the file is written next to the old one and renamed, so a crash never leaves a half written snapshot
+    if (this -> status != 'A' || this -> blocks.empty()){
+        sysMessage("Only an active blockchain can be saved. The snapshot was not written.");
+        return false;
+    }
+
+    string out(snapshotMagic, 6);
+    out += char(snapshotVersion);
+    out += char(Hasher::getDefaultVersion());
+    auto putInt = [&out](unsigned int value){
+        for (int i = 0; i < 4; i++)
+            out += char(value >> (8 * i));
+    };
+    auto putLong = [&out](unsigned long long value){
+        for (int i = 0; i < 8; i++)
+            out += char(value >> (8 * i));
+    };
+
+    putInt(this -> currentHeight);
+    putInt(strlen(this -> currentHash));
+    out += this -> currentHash;
+
+    string lastBlock;
+    BlockLog::encode(this -> blocks.back(), lastBlock);
+    putInt(lastBlock.length());
+    out += lastBlock;
+
+    int count = this -> accounts.getSize();
+    putInt(count);
+    out.reserve(out.size() + 28 * count + 4 * this -> blockStats.getKept() + 64);
+    for (int i = 0; i < count; i++)
+        out.append((const char*)this -> accounts.getAddress(i).getBytes(), 20);
+    for (int i = 0; i < count; i++)
+        putInt(this -> accounts.getBalance(i));
+    for (int i = 0; i < count; i++)
+        putInt(this -> accounts.getNonce(i));
+
+    string stats;
+    this -> blockStats.encode(stats);
+    putInt(stats.length());
+    out += stats;
+
+    Hasher checksum;
+    checksum.update(out.data(), out.size());
+    putLong(checksum.final());
+
+    string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (!file){
+        sysMessage("The snapshot " + path + " could not be written.");
+        return false;
+    }
+    bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+    written = fclose(file) == 0 && written;
+    error_code error;
+    if (written)
+        filesystem::rename(temporary, path, error);
+    if (!written || error){
+        sysMessage("The snapshot " + path + " could not be written.");
+        filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+bool Blockchain::loadSnapshot(const string &path){
+    // starts the blockchain from a snapshot (read with a single read, the account index is built afterwards)
+    // blocks after the snapshot can be replayed by attaching the block log
+    if (this -> status != 'I'){
+        sysMessage("The blockchain is already active. The snapshot was not loaded.");
+        return false;
+    }
+
+    error_code error;
+    size_t size = filesystem::file_size(path, error);
+    if (error){
+        sysMessage("The snapshot " + path + " could not be opened.");
+        return false;
+    }
+    string in(size, '\0');
+    FILE *file = fopen(path.c_str(), "rb");
+    bool read = file && fread(&in[0], 1, size, file) == size;
+    if (file)
+        fclose(file);
+    if (!read){
+        sysMessage("The snapshot " + path + " could not be read.");
+        return false;
+    }
+
+    // header and checksum
+    if (size < 16 || memcmp(in.data(), snapshotMagic, 6) != 0 || in[6] != snapshotVersion){
+        sysMessage("The file " + path + " is not a snapshot (or was written by another version). It was not loaded.");
+        return false;
+    }
+    if (in[7] != Hasher::getDefaultVersion()){
+        sysMessage("The snapshot " + path + " was written with another hash version. It was not loaded.");
+        return false;
+    }
+    const unsigned char *data = (const unsigned char*)in.data();
+    unsigned long long stored = 0;
+    for (int i = 7; i >= 0; i--)
+        stored = (stored << 8) | data[size - 8 + i];
+    Hasher checksum;
+    checksum.update(data, size - 8);
+    if (checksum.final() != stored){
+        sysMessage("The snapshot " + path + " is corrupted. It was not loaded.");
+        return false;
+    }
+
+    // fields (every read is bounds checked, ok turns false at the first one out of bounds)
+    size_t position = 8, end = size - 8;
+    bool ok = true;
+    auto getInt = [&](){
+        if (position + 4 > end){
+            ok = false;
+            return 0u;
+        }
+        unsigned int value = data[position] | data[position + 1] << 8 | data[position + 2] << 16 | (unsigned int)data[position + 3] << 24;
+        position += 4;
+        return value;
+    };
+    auto getBytes = [&](size_t length){
+        if (!ok || length > end - position){
+            ok = false;
+            return (const unsigned char*)NULL;
+        }
+        position += length;
+        return data + position - length;
+    };
+
+    int height = getInt();
+    unsigned int hashLength = getInt();
+    const unsigned char *hash = getBytes(hashLength);
+    unsigned int blockLength = getInt();
+    const unsigned char *blockData = getBytes(blockLength);
+    Block lastBlock;
+    if (!ok || !BlockLog::decode(blockData, blockLength, lastBlock) || lastBlock.getHeight() != height ||
+        lastBlock.getHash() != string((const char*)hash, hashLength)){
+        sysMessage("The snapshot " + path + " contains an invalid block. It was not loaded.");
+        return false;
+    }
+
+    unsigned int count = getInt();
+    const unsigned char *addresses = getBytes(size_t(count) * 20);
+    const unsigned char *balances = getBytes(size_t(count) * 4);
+    const unsigned char *nonces = getBytes(size_t(count) * 4);
+    unsigned int statsLength = getInt();
+    const unsigned char *statsData = getBytes(statsLength);
+    BlockStats stats;
+    if (!ok || !stats.decode(statsData, statsLength) || (stats.getCount() > 0 && stats.getLastHeight() != height)){
+        sysMessage("The snapshot " + path + " is incomplete. It was not loaded.");
+        return false;
+    }
+
+    // rebuild the state
+    this -> flushPipeline();
+    auto readInt = [](const unsigned char *p){
+        return int(p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24);
+    };
+    this -> accounts.clear();
+    this -> accounts.reserve(count);
+    for (unsigned int i = 0; i < count; i++){
+        int index = this -> accounts.insert(Address(addresses + 20 * i));
+        this -> accounts.setBalance(index, readInt(balances + 4 * i));
+        this -> accounts.setNonce(index, readInt(nonces + 4 * i));
+    }
+
+    this -> blockStats = stats;
+
+    this -> blocks.clear();
+    this -> blocks.push_back(lastBlock);
+    this -> wallets.clear();
+    this -> emptyWallets.clear();
+    this -> currentHeight = height;
+    this -> setCurrentHash((char*)lastBlock.getHash().c_str());
+    this -> setStatus('A');
+    return true;
+}
+
+bool Blockchain::resume(const string &snapshotPath, const string &logPath){
+    // starts from the snapshot (if there is one) and replays the blocks of the log that are newer
+    if (filesystem::exists(snapshotPath) && !this -> loadSnapshot(snapshotPath))
+        return false;
+    return this -> openBlockLog(logPath);
+}
+
+void Blockchain::closeBlockLog(){
+    this -> blockLog.close();
+}
+
+bool Blockchain::getBlock(int height, Block &bl){
+    // random access to blocks: through the log if one is attached, otherwise from memory
+    if (this -> blockLog.isOpen() && this -> blockLog.readByHeight(height, bl))
+        return true;
+    for (auto it = this -> blocks.rbegin(); it != this -> blocks.rend(); it++)
+        if ((*it).getHeight() == height){
+            bl = *it;
+            return true;
+        }
+    return false;
+}
+
+bool Blockchain::getBlock(const string &hash, Block &bl){
+    if (this -> blockLog.isOpen() && this -> blockLog.readByHash(hash, bl))
+        return true;
+    for (auto it = this -> blocks.rbegin(); it != this -> blocks.rend(); it++)
+        if ((*it).getHash() == hash){
+            bl = *it;
+            return true;
+        }
+    return false;
+}
+
+void Blockchain::applyBlockOnState(Block &bl){
+    // applies the transactions from a block on the wallets' histories and drops them from the mempool
+    // balances and nonces are written by committing the overlay the block was validated on
+    this -> applyBlockOnHistories(bl, this -> applyBlockOnMempool(bl));
+}
+
+vector<int> Blockchain::applyBlockOnMempool(Block &bl){
+    // marks the transactions of a block as mined and drops them from the mempool
+    // returns the id each of them had in the mempool (-1 if it was not there), the histories confirm them by it
+    vector<int> pendingIds;
+    pendingIds.reserve(bl.getTransactions().size());
+    bl.markMined();
+    for (auto it = bl.getTransactions().begin(); it != bl.getTransactions().end(); it++){
+        const Hash &hash = (*it) -> getHash();
+        if (!this -> mempool.hasTx(hash)){
+            pendingIds.push_back(-1);
+            continue;
+        }
+        pendingIds.push_back(this -> mempool.getTxRef(hash).getId());
+
+        // the tx has been mined
+        this -> mempool.deleteTx(hash);
+    }
+    return pendingIds;
+}
+
+void Blockchain::applyBlockOnHistories(Block &bl, const vector<int> &pendingIds){
+    // moves the transactions of a block to its height in the wallets' histories (pendingIds from applyBlockOnMempool)
+    if (!this -> trackHistory)
+        return;
+    for (size_t i = 0; i < bl.getTransactions().size(); i++){
+        const TxRef &ref = bl.getTransactions()[i];
+        const Transaction &tx = *ref;
+
+        // transactions which never went through this mempool (e.g. blocks replayed from a log)
+        // are added to the histories instead
+        if (pendingIds[i] == -1){
+            this -> historyOf(tx.getFrom()).addTx(ref, bl.getHeight());
+            if (tx.getTo() != tx.getFrom())
+                this -> historyOf(tx.getTo()).addTx(ref, bl.getHeight());
+            continue;
+        }
+
+        // the others are already in the histories as pending, they move to the height of the block
+        this -> historyOf(tx.getFrom()).confirmTx(pendingIds[i], ref, bl.getHeight());
+        if (tx.getTo() != tx.getFrom())
+            this -> historyOf(tx.getTo()).confirmTx(pendingIds[i], ref, bl.getHeight());
+    }
+}
+
+void Blockchain::processBlock(Block &bl){
+    // processes a block and adds it to the blockchain
+    // the state and the mempool are updated here, the rest (histories, statistics, wallets) by finishBlock
+    // in pipelined mode finishBlock runs on the block worker, so the next block can be prepared in the meantime
+    // (it only needs the state and the mempool, which are up to date when this function returns)
+    this -> flushPipeline();
+    if (bl.getHeight() != this -> currentHeight + 1){
+        sysMessage("The height of the new block is not consistent with the current height. The block was not processed.");
+        return;
+    }
+    if (bl.getParentHash() != this -> currentHash){
+        sysMessage("The parent hash of the new block does not match the hash of the current block. The block was not processed.");
+        return;
+    }
+    StateOverlay state(this -> accounts);
+    if (!this -> validateBlockTransactions(bl, state)){
+        sysMessage("Block contains invalid transactions and will not be processed.");
+        return;
+    }
+
+    this -> blocks.push_back(bl);
+    state.commit();                                     // balances and nonces
+    Block &added = this -> blocks.back();               // we apply the block which was copied into the blockchain
+                                                        // (it gets mined copies of the transactions, bl keeps the pending ones)
+    vector<int> pendingIds = this -> applyBlockOnMempool(added);
+    this -> setCurrentHeight(this -> currentHeight + 1);
+    this -> setCurrentHash((char*)bl.getHash().c_str());
+    if (this -> blockLog.isOpen() && bl.getHeight() > this -> blockLog.getLastHeight())
+        this -> blockLog.append(bl);
+    vector<TxRef> evicted = this -> evictSuperseded(added);
+
+    if (!this -> pipelined){
+        this -> finishBlock(added, pendingIds, evicted);
+        return;
+    }
+    if (!this -> blockWorker)
+        this -> blockWorker = new ThreadPool(1);
+    this -> blockWorker -> submit([this, &added, pendingIds = move(pendingIds), evicted = move(evicted)]{
+        this -> finishBlock(added, pendingIds, evicted);
+    });
+}
+
+void Blockchain::finishBlock(Block &bl, const vector<int> &pendingIds, const vector<TxRef> &evicted){
+    // the part of processing a block which doesn't touch the state or the mempool
+    // in pipelined mode it runs on the block worker, so it must not call anything that waits for it (flushPipeline)
+    this -> applyBlockOnHistories(bl, pendingIds);
+    this -> updateStatistics(bl);
+    this -> dropFromHistories(evicted);
+    this -> cleanWallets();
+
+    if (this -> snapshotInterval > 0 && this -> currentHeight % this -> snapshotInterval == 0)
+        this -> saveSnapshot(this -> snapshotPath);
+}
+
+void Blockchain::flushPipeline(){
+    // waits until the block worker is done: the last block is finished and the history updates deferred
+    // by sendTx are applied. everything that reads or writes the histories calls it first
+    this -> submitDeferredHistory();
+    this -> waitForBlockWorker();
+}
+
+void Blockchain::waitForBlockWorker() const{
+    // waits for the blocks handed to the block worker (the statistics are up to date afterwards)
+    // the history updates still deferred by sendTx are not applied, that needs flushPipeline
+    if (this -> blockWorker)
+        this -> blockWorker -> wait();
+}
+
+void Blockchain::submitDeferredHistory(){
+    // hands the history updates deferred by sendTx to the block worker, after the blocks processed before them
+    if (this -> deferredHistory.empty())
+        return;
+    if (!this -> blockWorker)
+        this -> blockWorker = new ThreadPool(1);
+    this -> blockWorker -> submit([this, updates = move(this -> deferredHistory)]{
+        for (auto it = updates.begin(); it != updates.end(); it++){
+            if (it -> first)
+                this -> addToHistories(it -> second);
+            else
+                this -> dropFromHistories(vector<TxRef>(1, it -> second));
+        }
+    });
+    this -> deferredHistory.clear();
+}
+
+void Blockchain::updateStatistics(Block& bl){
+    // updates the statistics of the blockchain after a new block is added, O(1) besides the txs of the block
+    if (this -> blockStats.getLastHeight() != this -> currentHeight - 1){
+        if (this -> blockStats.getCount() > 0)
+            warning("The block statistics did not follow the chain. They start again from height " + to_string(this -> currentHeight) + ".");
+        this -> blockStats.clear(this -> currentHeight);
+    }
+
+    // average amount of the transactions in the new block
+    float average = 0;
+    for (auto it = bl.getTransactions().begin(); it != bl.getTransactions().end(); it++){
+        average += (*it) -> getAmount();
+    }
+    if (average != 0)
+        average /= bl.getTransactions().size();
+
+    this -> blockStats.add(average);
+}
+
+void Blockchain::generateGenesis(){
+    // generates the genesis block of the blockchain
+    // this block is special 
+    if (this -> status != 'I'){
+        sysMessage("The blockchain is not in initializing state. The genesis block was not generated.");
+        return;
+    }
+
+    // generate the first block
+    Block genesisBlock("0xdeadbeef", 0);    // parent hash is a special value (usually random)
+    this -> blocks.push_back(genesisBlock);
+
+    // generate the god wallet
+    Wallet godWallet(Transaction::getGodAddress(), 100000);
+    int godIndex = this -> accounts.insert(Transaction::getGodAddress());
+    this -> accounts.setBalance(godIndex, godWallet.getBalance());
+    if (this -> trackHistory)
+        this -> wallets.insert_or_assign(Transaction::getGodAddress(), godWallet);     // operator[] would create a random wallet first
+
+    // set the remaining fields for the blockchain
+    this -> currentHeight = 0;
+    this -> setCurrentHash((char*)genesisBlock.getHash().c_str());
+    this -> setStatus('A');
+}
+
+void Blockchain::sendTx(Transaction &tx){
+    // sends a transaction to the mempool
+    if (!validateTx(tx, StateOverlay(this -> accounts))){
+        sysMessage("The transaction is invalid. It will not be added to the mempool.");
+        return;
+    }
+
+    // if the mempool is full, a transaction paying a higher fee replaces the cheapest one
+    // (only if the mempool takes it otherwise: a duplicate or a fee under the minimum must not evict anything)
+    if (this -> mempool.isFull() && this -> mempool.getLowestFeeTx() -> getFee() < tx.getFee() &&
+        tx.getFee() >= this -> mempool.getMinFee() && !this -> mempool.hasTx(tx.getHash())){
+        // the wallets hold handles to the evicted tx, so they drop it first
+        TxRef lowest = this -> mempool.getTxRef(this -> mempool.getLowestFeeTx() -> getHash());
+        if (this -> pipelined && this -> trackHistory)
+            this -> deferredHistory.push_back(make_pair(false, lowest));
+        else
+            this -> dropFromHistories(vector<TxRef>(1, lowest));
+        Transaction evicted = this -> mempool.evictLowestFee();
+        info("The mempool is full. The transaction with the lowest fee was evicted: " + evicted.getHash().toHex());
+    }
+    if (!this -> mempool.addTx(tx) || !this -> trackHistory)
+        return;
+
+    // we also register the tx in the respective wallets
+    // in pipelined mode the block worker might be using the histories, the update waits for it (in order)
+    if (!this -> pipelined){
+        this -> addToHistories(this -> mempool.getTxList().back());
+        return;
+    }
+    this -> deferredHistory.push_back(make_pair(true, this -> mempool.getTxList().back()));
+    if (int(this -> deferredHistory.size()) >= deferredHistoryBatch)
+        this -> submitDeferredHistory();    // applied while the next transactions are validated
+}
+
+vector<char> Blockchain::sendTxBatch(const vector<Transaction> &txs){
+    // sends several transactions to the mempool at once and returns the status of each of them:
+    //   A - added, I - not mineable, S - unknown sender, N - nonce already used,
+    //   B - not enough funds (the transactions of the same sender before it in the batch are counted as well),
+    //   L - fee below the minimum of the mempool, D - already in the mempool or earlier in the batch,
+    //   F - the mempool is full (nothing cheaper to evict, or evicted by a later transaction of the batch)
+    // the state of every sender is read once, then the mempool takes the valid ones in one go
+    struct SenderState{
+        int balance;            // -1 if the sender does not exist
+        int nonce;
+        long long spent;        // amounts and fees of its transactions accepted so far in the batch
+    };
+    unordered_map<Address, SenderState> senders;
+    unordered_set<Hash> seen;               // hashes of the batch
+    seen.reserve(txs.size());
+    vector<char> statuses(txs.size(), 'A');
+
+    for (size_t i = 0; i < txs.size(); i++){
+        const Transaction &tx = txs[i];
+        if (!tx.isMineable()){
+            statuses[i] = 'I';
+            continue;
+        }
+        if (tx.getFee() < this -> mempool.getMinFee()){
+            statuses[i] = 'L';
+            continue;
+        }
+        if (this -> mempool.hasTx(tx.getHash()) || !seen.insert(tx.getHash()).second){
+            statuses[i] = 'D';
+            continue;
+        }
+
+        auto sender = senders.find(tx.getFrom());
+        if (sender == senders.end()){
+            int index = this -> accounts.find(tx.getFrom());
+            SenderState state = {-1, 0, 0};
+            if (index != -1)
+                state = {this -> accounts.getBalance(index), this -> accounts.getNonce(index), 0};
+            sender = senders.insert(make_pair(tx.getFrom(), state)).first;
+        }
+        SenderState &state = sender -> second;
+        if (state.balance < 0){
+            statuses[i] = 'S';
+            continue;
+        }
+        if (tx.getNonce() < state.nonce + 1 && tx.getNonce() != 0){
+            statuses[i] = 'N';
+            continue;
+        }
+        long long cost = (long long)tx.getAmount() + tx.getFee();
+        if (cost > state.balance - state.spent){
+            statuses[i] = 'B';
+            continue;
+        }
+        state.spent += cost;
+    }
+
+    vector<TxRef> evicted;
+    vector<TxRef> added = this -> mempool.addTxBatch(txs, statuses, evicted);
+
+    // transactions of the batch evicted by later ones never reach the histories
+    if (!evicted.empty()){
+        unordered_map<int, int> batchIndex;
+        for (size_t i = 0; i < added.size(); i++)
+            if (!added[i].isNull())
+                batchIndex[added[i].getId()] = i;
+        vector<TxRef> older;
+        for (auto it = evicted.begin(); it != evicted.end(); it++){
+            auto found = batchIndex.find(it -> getId());
+            if (found == batchIndex.end()){
+                older.push_back(*it);
+                continue;
+            }
+            statuses[found -> second] = 'F';
+            added[found -> second].reset();
+        }
+        evicted.swap(older);
+    }
+
+    int rejected = count_if(statuses.begin(), statuses.end(), [](char status){ return status != 'A'; });
+    if (rejected > 0)
+        warning(to_string(rejected) + " of the " + to_string(txs.size()) + " transactions were not added to the mempool.");
+    if (!this -> trackHistory)
+        return statuses;
+
+    // the wallets drop the evicted transactions and register the new ones (deferred in pipelined mode, see sendTx)
+    if (this -> pipelined){
+        for (auto it = evicted.begin(); it != evicted.end(); it++)
+            this -> deferredHistory.push_back(make_pair(false, *it));
+        for (auto it = added.begin(); it != added.end(); it++)
+            if (!it -> isNull())
+                this -> deferredHistory.push_back(make_pair(true, *it));
+        this -> submitDeferredHistory();
+        return statuses;
+    }
+    this -> dropFromHistories(evicted);
+    for (auto it = added.begin(); it != added.end(); it++)
+        if (!it -> isNull())
+            this -> addToHistories(*it);
+    return statuses;
+}
+
+Block Blockchain::proposeBlock(){
+    // proposes a new block to be added to the blockchain
+    // the block is proposed based on the transactions in the mempool
+    if (this -> mempool.getTxList().empty()){
+        info("The mempool is empty. Empty block was generated.");
+        return Block(this -> currentHash, this -> currentHeight + 1);
+    }
+
+    // the mempool keeps the transactions of every sender ordered by nonce, so only the next transaction
+    // of each sender can be included at any point. we merge these queues by always picking the
+    // highest fee transaction that can be executed next (this way nothing is skipped because of its nonce)
+    // equal fees are ordered by hash (not by address in memory) so the same mempool always gives the same block
+    typedef pair<pair<long, unsigned long long>, const Transaction*> Candidate;      // ((fee, ~hash), tx)
+    priority_queue<Candidate> candidates;
+    unordered_map<Address, int> parked;                    // senders waiting for funds -> nonce of their next tx
+
+    StateOverlay state(this -> accounts);    // simulates the block on top of the current state
+
+    auto rank = [](const Transaction *tx){
+        return make_pair(long(tx -> getFee()), ~tx -> getHash().getValue());
+    };
+
+    // pushes the best transaction of a sender with the given nonce (false if there is none)
+    // with below set only the transactions ranked after it are considered (it was tried and could not be afforded)
+    auto pushNext = [&](const Address &sender, int nonce, const Transaction *below = NULL){
+        const Mempool::NonceQueue *queue = this -> mempool.getSenderQueue(sender);
+        if (!queue)
+            return false;
+        auto range = queue -> equal_range(nonce);
+        const Transaction *best = NULL;
+        for (auto it = range.first; it != range.second; it++)
+            if ((!below || rank(it -> second) < rank(below)) && (!best || rank(best) < rank(it -> second)))
+                best = it -> second;
+        if (best)
+            candidates.push(make_pair(rank(best), best));
+        return best != NULL;
+    };
+
+    for (auto it = this -> mempool.getSenderQueues().begin(); it != this -> mempool.getSenderQueues().end(); it++)
+        if (state.exists(it -> first))
+            pushNext(it -> first, state.getNonce(it -> first) + 1);
+
+    Block newBlock(this -> currentHash, this -> currentHeight + 1);
+    while (!candidates.empty()){
+        const Transaction &tx = *candidates.top().second;
+        candidates.pop();
+
+        if (!validateTx(tx, state)){
+            // a cheaper transaction with the same nonce might be affordable, otherwise the sender
+            // might receive funds later in this block (then its best transaction is tried again)
+            if (!pushNext(tx.getFrom(), tx.getNonce(), &tx))
+                parked[tx.getFrom()] = tx.getNonce();
+            continue;
+        }
+        // the block shares the pooled tx with the mempool (the applied block gets its own mined copy)
+        newBlock.addTx(this -> mempool.getTxRef(tx.getHash()));
+
+        // we simulate balance updates to produce a valid block
+        state.applyTx(tx);
+
+        pushNext(tx.getFrom(), tx.getNonce() + 1);
+
+        // the receiver might have been waiting for these funds
+        auto parkedIt = parked.find(tx.getTo());
+        if (parkedIt != parked.end()){
+            pushNext(parkedIt -> first, parkedIt -> second);
+            parked.erase(parkedIt);
+        }
+    }
+
+    int left = this -> mempool.getTxList().size() - newBlock.getTransactions().size();
+    if (left > 0)
+        warning(to_string(left) + " transactions were skipped (nonce gaps or insufficient funds).");
+
+    return newBlock;
+}
+
+int Blockchain::getAccountNonce(const Address &addr) const{
+    // returns the nonce of an account
+    int index = this -> accounts.find(addr);
+    return index == -1 ? 0 : this -> accounts.getNonce(index);
+}
+
+Transaction Blockchain::readTx(){
+    // reads a tx from the console and sets the nonce if necessary
+    Transaction tx;
+    cin >> tx;
+
+    if (tx.getNonce() != 0)
+        return tx;
+
+    if (!this -> accounts.contains(tx.getFrom())){
+        warning("The sender of the transaction does not exist.");
+        tx.setNonce(1);
+        return tx;
+    }
+
+    tx.setNonce(this -> getAccountNonce(tx.getFrom()) + 1);
+    tx.updateHash();
+
+    return tx;
+}
+
+void Blockchain::cleanMempool(){
+    // this functions drops old transactions from the mempool
+    // if the nonce of an account is higher than a transaction in the mempool, it is dropped
+    // every sender with transactions in the mempool is checked (see the overload below for the usual case)
+    this -> flushPipeline();
+    unordered_map<Address, int> watermarks;
+    for (auto it = this -> mempool.getSenderQueues().begin(); it != this -> mempool.getSenderQueues().end(); it++)
+        watermarks[it -> first] = this -> getAccountNonce(it -> first);
+    this -> dropFromHistories(this -> mempool.evictBelow(watermarks));
+}
+
+void Blockchain::cleanMempool(const Block &bl){
+    // drops the transactions superseded by a block which was just applied
+    this -> flushPipeline();
+    this -> dropFromHistories(this -> evictSuperseded(bl));
+}
+
+vector<TxRef> Blockchain::evictSuperseded(const Block &bl){
+    // the mempool part of cleanMempool(bl), the evicted transactions are returned for the histories
+    // nonces only change through the sender's own transactions, so only the senders of the block are checked
+    unordered_map<Address, int> watermarks;
+    for (auto it = bl.getTransactions().begin(); it != bl.getTransactions().end(); it++)
+        watermarks[(*it) -> getFrom()] = 0;
+    for (auto it = watermarks.begin(); it != watermarks.end(); it++)
+        it -> second = this -> getAccountNonce(it -> first);
+    return this -> mempool.evictBelow(watermarks);
+}
+
+void Blockchain::dropFromHistories(const vector<TxRef> &txs){
+    // removes transactions which left the mempool without being mined from the wallets' histories
+    if (!this -> trackHistory)
+        return;
+    for (auto it = txs.begin(); it != txs.end(); it++){
+        this -> historyOf((*it) -> getFrom()).deleteTx(it -> getId());
+        this -> markIfEmpty((*it) -> getFrom());
+        if ((*it) -> getTo() != (*it) -> getFrom()){    // avoid tx to self
+            this -> historyOf((*it) -> getTo()).deleteTx(it -> getId());
+            this -> markIfEmpty((*it) -> getTo());
+        }
+    }
+}
+
+void Blockchain::markIfEmpty(const Address &addr){
+    // registers a wallet left without transactions, so cleanWallets only has to look at these
+    if (this -> walletRetention == keepEmptyWallets || addr == Transaction::getGodAddress())
+        return;
+    auto it = this -> wallets.find(addr);
+    if (it != this -> wallets.end() && it -> second.getHistory().empty())
+        this -> emptyWallets[addr] = this -> currentHeight;
+}
+
+void Blockchain::cleanWallets(){
+    // removes wallets that have no transactions (god wallet is excluded)
+    // only the wallets which were left empty are examined, they are removed once they were idle for walletRetention blocks
+    for (auto it = this -> emptyWallets.begin(); it != this -> emptyWallets.end();){
+        auto wallet = this -> wallets.find(it -> first);
+        if (wallet == this -> wallets.end() || !wallet -> second.getHistory().empty()){
+            // it was removed already or it has transactions again
+            it = this -> emptyWallets.erase(it);
+            continue;
+        }
+        if (this -> currentHeight - it -> second < this -> walletRetention){
+            it++;
+            continue;
+        }
+        this -> wallets.erase(wallet);
+        it = this -> emptyWallets.erase(it);
+    }
+}
+
+void Blockchain::importWallets(const unordered_map<Address, Wallet> &wallets){
+    // loads the balances and nonces of the wallets into the account store
+    // the wallets themselves are kept for their history
+    this -> flushPipeline();
+    for (auto it = wallets.begin(); it != wallets.end(); it++){
+        int index = this -> accounts.insert(it -> first);
+        this -> accounts.setBalance(index, it -> second.getBalance());
+        this -> accounts.setNonce(index, it -> second.getNonce());
+    }
+    if (!this -> trackHistory)
+        return;
+    this -> wallets = wallets;
+    this -> emptyWallets.clear();
+    for (auto it = this -> wallets.begin(); it != this -> wallets.end(); it++)
+        this -> markIfEmpty(it -> first);
+}
+
+Wallet& Blockchain::historyOf(const Address &addr){
+    // returns the wallet holding the history of an address (an empty one is created if needed)
+    auto it = this -> wallets.find(addr);
+    if (it == this -> wallets.end())
+        it = this -> wallets.insert(make_pair(addr, Wallet(addr, 0))).first;
+    return it -> second;
+}
+
+void Blockchain::addToHistories(const TxRef &tx){
+    // registers a pending transaction in the wallets of its sender and receiver (created if they don't exist)
+    this -> historyOf(tx -> getFrom()).addTx(tx);
+    if (tx -> getTo() != tx -> getFrom())     // avoid tx to self
+        this -> historyOf(tx -> getTo()).addTx(tx);
+}
+
+// ----------------- TRANSACTION INGESTION -----------------
+
+class TxQueue{
+    // unbounded queue with many producers and a single consumer, lock free (Vyukov's intrusive MPSC queue)
+    // a producer only swaps the tail and links the old one to its node, the consumer follows the links from a stub
+    // node it owns. a push which swapped the tail but didn't link yet is seen as empty until it does
+    struct Node{
+        atomic<Node*> next;
+        Transaction tx;
+
+        Node();
+        Node(const Transaction&);
+    };
+
+    atomic<Node*> tail;     // last node pushed (producers)
+    Node *head;             // stub node, its successor holds the next transaction (consumer)
+
+    public:
+        // CONSTRUCTORS
+        TxQueue();
+        TxQueue(const TxQueue&) = delete;
+
+        // utility functions
+        void push(const Transaction&);
+        bool pop(Transaction&);
+        bool isEmpty() const;
+
+        // OPERATORS
+        TxQueue& operator=(const TxQueue&) = delete;
+
+        // DESTRUCTOR
+        ~TxQueue();
+};
+
+// CONSTRUCTORS
+TxQueue::Node::Node():next(NULL) {}
+
+TxQueue::Node::Node(const Transaction &tx):next(NULL), tx(tx) {}
+
+TxQueue::TxQueue(){
+    this -> head = new Node();
+    this -> tail.store(this -> head);
+}
+
+// utility functions
+void TxQueue::push(const Transaction &tx){
+    // any thread
+    Node *node = new Node(tx);
+    Node *previous = this -> tail.exchange(node, memory_order_acq_rel);
+    previous -> next.store(node, memory_order_release);
+}
+
+bool TxQueue::pop(Transaction &tx){
+    // consumer thread only, false if there is nothing to take
+    Node *next = this -> head -> next.load(memory_order_acquire);
+    if (!next)
+        return false;
+    tx = next -> tx;
+    delete this -> head;
+    this -> head = next;    // the node becomes the new stub
+    return true;
+}
+
+bool TxQueue::isEmpty() const{
+    return this -> head -> next.load(memory_order_acquire) == NULL;
+}
+
+// DESTRUCTOR
+TxQueue::~TxQueue(){
+    // no producer can be pushing anymore
+    while (this -> head){
+        Node *next = this -> head -> next.load(memory_order_relaxed);
+        delete this -> head;
+        this -> head = next;
+    }
+}
+
+class TxIngestor{
+    // thread safe front end of Blockchain::sendTx
+    // any number of threads submit transactions through a lock free queue, a sequencer thread takes them in
+    // batches and sends them to the blockchain (sendTxBatch) while holding the chain lock
+    // the blockchain stays single threaded: whoever mines blocks in the meantime holds the same lock (getChainLock)
+    Blockchain *bc;
+    TxQueue queue;
+    int batchSize;                          // most transactions sent under one acquisition of the chain lock
+    mutex chainLock;
+    mutex wakeLock;
+    condition_variable wake;                // signaled when transactions arrive for a sleeping sequencer (or on stop)
+    condition_variable batchDone;           // signaled after every batch (flush waits on it)
+    atomic<bool> sleeping, stopping;
+    atomic<long long> submitted, sequenced, accepted;
+    thread sequencer;
+
+    void sequencerLoop();
+
+    public:
+        // CONSTRUCTORS
+        TxIngestor(Blockchain &bc, int batchSize = 1024);
+        TxIngestor(const TxIngestor&) = delete;
+
+        // utility functions
+        void submit(const Transaction&);
+        void flush();
+
+        // OPERATORS
+        TxIngestor& operator=(const TxIngestor&) = delete;
+
+        // GETTERS
+        mutex& getChainLock();
+        int getBatchSize() const;
+        long long getSubmitted() const;
+        long long getSequenced() const;
+        long long getAccepted() const;
+
+        // DESTRUCTOR
+        ~TxIngestor();
+};
+
+// CONSTRUCTORS
+TxIngestor::TxIngestor(Blockchain &bc, int batchSize):bc(&bc), batchSize(batchSize), sleeping(false), stopping(false),
+                                                      submitted(0), sequenced(0), accepted(0){
+    if (batchSize < 1){
+        sysMessage("The batch size of the ingestion must be positive. Default value (1024) set.");
+        this -> batchSize = 1024;
+    }
+    this -> sequencer = thread(&TxIngestor::sequencerLoop, this);
+}
+
+// GETTERS
+mutex& TxIngestor::getChainLock(){
+    return this -> chainLock;
+}
+
+int TxIngestor::getBatchSize() const{
+    return this -> batchSize;
+}
+
+long long TxIngestor::getSubmitted() const{
+    return this -> submitted.load();
+}
+
+long long TxIngestor::getSequenced() const{
+    return this -> sequenced.load();
+}
+
+long long TxIngestor::getAccepted() const{
+    return this -> accepted.load();
+}
+
+// utility functions
+void TxIngestor::submit(const Transaction &tx){
+    // any thread, never blocks (the hash is computed by the caller, when the transaction is built)
+    // the flag is read after the node is linked, the fence pairs with the one in sequencerLoop: either the sequencer
+    // sees the node before it sleeps or this thread sees it sleeping and wakes it up. a push which is not linked yet
+    // is covered by the same rule, since its producer wakes the sequencer once it links the node
+    this -> queue.push(tx);
+    this -> submitted.fetch_add(1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (this -> sleeping.load()){
+        lock_guard<mutex> guard(this -> wakeLock);
+        this -> wake.notify_one();
+    }
+}
+
+void TxIngestor::flush(){
+    // waits until the sequencer has sent every transaction submitted so far
+    long long target = this -> submitted.load();
+    unique_lock<mutex> guard(this -> wakeLock);
+    this -> batchDone.wait(guard, [this, target]{ return this -> sequenced.load() >= target; });
+}
+
+void TxIngestor::sequencerLoop(){
+    vector<Transaction> batch;
+    batch.reserve(this -> batchSize);
+    while (true){
+        Transaction tx;
+        while (int(batch.size()) < this -> batchSize && this -> queue.pop(tx))
+            batch.push_back(tx);
+
+        if (batch.empty()){
+            if (this -> stopping.load() && this -> queue.isEmpty())
+                return;
+            // nothing to do, the sequencer sleeps until a producer wakes it up (see submit for why no push is missed)
+            unique_lock<mutex> guard(this -> wakeLock);
+            this -> sleeping.store(true);
+            atomic_thread_fence(memory_order_seq_cst);
+            this -> wake.wait(guard, [this]{ return this -> stopping.load() || !this -> queue.isEmpty(); });
+            this -> sleeping.store(false);
+            continue;
+        }
+
+        vector<char> statuses;
+        {
+            lock_guard<mutex> guard(this -> chainLock);
+            statuses = this -> bc -> sendTxBatch(batch);
+        }
+        this -> accepted.fetch_add(count(statuses.begin(), statuses.end(), 'A'));
+        {
+            lock_guard<mutex> guard(this -> wakeLock);
+            this -> sequenced.fetch_add(batch.size());
+        }
+        this -> batchDone.notify_all();
+        batch.clear();
+    }
 }
 
-Blockchain& Blockchain::operator=(const Blockchain &obj){
-    if (this == &obj)
-        return *this;
+// DESTRUCTOR
+TxIngestor::~TxIngestor(){
+    // the transactions already submitted are still sent
+    {
+        lock_guard<mutex> guard(this -> wakeLock);
+        this -> stopping.store(true);
+    }
+    this -> wake.notify_one();
+    this -> sequencer.join();
+}
 
-    this -> currentHeight = obj.currentHeight;
-    this -> setCurrentHash(obj.currentHash);
-    this -> mempool = obj.mempool;
-    this -> blocks = obj.blocks;    // deep copy
-    this -> wallets = obj.wallets;
-    this -> status = obj.status;
-    this -> setTxStats(obj.txStats);
-    this -> averageTransacted = obj.averageTransacted;
+// ----------------- WORKLOAD -----------------
 
-    return *this;
-}
+class Random{
+    // xoshiro256** seeded through splitmix64: fast, small and the same sequence on every platform
+    // (rand() is slow, has a small range and differs between standard libraries)
+    unsigned long long state[4];
 
-Transaction Blockchain::operator[](string hash){
-    // search for tx in the mempool
-    for (auto it = this -> mempool.getTxList().begin(); it != this -> mempool.getTxList().end(); it++)
-        if ((*it).getHash() == hash)
-            return *it;
+    static unsigned long long rotl(unsigned long long x, int k);
 
-    // search for tx in blocks
-    for (auto it = this -> blocks.begin(); it != this -> blocks.end(); it++)
-        for (auto it2 = (*it).getTransactions().begin(); it2 != (*it).getTransactions().end(); it2++)
-            if ((*it2).getHash() == hash)
-                return *it2;
+    public:
+        // CONSTRUCTORS
+        Random(unsigned long long seed);
 
-    sysMessage("The transaction with the hash provided was not found in the blockchain.");
-    return Transaction();
-}
+        // utility functions
+        unsigned long long next();
+        int range(int low, int high);
+        double uniform();
+        double exponential(double mean);
+};
 
-Blockchain& Blockchain::operator--(){
-    // remove the last tx from the mempool
-    if (this -> mempool.getTxList().empty()){
-        sysMessage("The mempool is empty. No transactions to remove.");
-        return *this;
+// CONSTRUCTORS
+Random::Random(unsigned long long seed){
+    for (int i = 0; i < 4; i++){
+        seed += 0x9e3779b97f4a7c15;
+        unsigned long long z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        this -> state[i] = z ^ (z >> 31);
     }
-    --(this -> mempool);
-    return *this;
 }
 
-Blockchain Blockchain::operator--(int){
-    // remove the last tx from the mempool
-    Blockchain copy = *this;
-    --(*this);
-    return copy;
+// utility functions
+unsigned long long Random::rotl(unsigned long long x, int k){
+    return (x << k) | (x >> (64 - k));
 }
 
-Blockchain Blockchain::operator+(Block bl){
-    // process a block and add it to the blockchain
-    // not using const Block& due to conflict with processBlock function
-    Blockchain copy = *this;
-    copy.processBlock(bl);
-    return copy;
+unsigned long long Random::next(){
+    unsigned long long *s = this -> state;
+    unsigned long long result = rotl(s[1] * 5, 7) * 9;
+    unsigned long long t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
 }
 
-Blockchain Blockchain::operator-(const Transaction &tx){
-    // remove a transaction from the mempool
-    Blockchain copy = *this;
-    copy.mempool.deleteTx(tx.getHash());
-    return copy;
+int Random::range(int low, int high){
+    // uniform in [low, high], the high bits are scaled instead of using % (no modulo bias worth noticing)
+    unsigned long long span = (unsigned long long)(high - low) + 1;
+    return low + int(((this -> next() >> 32) * span) >> 32);
 }
 
-bool Blockchain::operator<(const Blockchain &obj) const{
-    // compare based on the height of the blockchain
-    return this -> currentHeight < obj.currentHeight;
+double Random::uniform(){
+    // uniform in [0, 1) with 53 random bits
+    return (this -> next() >> 11) * (1.0 / 9007199254740992.0);
 }
 
-bool Blockchain::operator>(const Blockchain &obj){
-    return obj < *this;
+double Random::exponential(double mean){
+    return -mean * log(1 - this -> uniform());
 }
 
-bool Blockchain::operator==(const Blockchain &obj){
-    // check if two blockchains are the same
-    
-    return this -> currentHeight ==  obj.currentHeight && 
-           strcmp(this -> currentHash, obj.currentHash) == 0 &&
-           this -> mempool       ==  obj.mempool;
+class ZipfSampler{
+    // picks indexes in [0, n) with probability proportional to 1 / (index + 1)^exponent
+    // exponent 0 is uniform, around 1 a few senders send most of the transactions
+    vector<double> cdf;
+    double exponent;
+
+    public:
+        // CONSTRUCTORS
+        ZipfSampler();
+        ZipfSampler(int n, double exponent);
+
+        // utility functions
+        int sample(Random &random) const;
+
+        // GETTERS
+        int getSize() const;
+};
+
+// CONSTRUCTORS
+ZipfSampler::ZipfSampler():exponent(0) {}
+
+ZipfSampler::ZipfSampler(int n, double exponent):exponent(exponent){
+    if (exponent <= 0 || n <= 0){
+        // uniform sampling does not need a table
+        this -> exponent = 0;
+        this -> cdf.assign(1, max(n, 0));
+        return;
+    }
+    this -> cdf.resize(n);
+    double sum = 0;
+    for (int i = 0; i < n; i++){
+        sum += pow(i + 1, -exponent);
+        this -> cdf[i] = sum;
+    }
+    for (int i = 0; i < n; i++)
+        this -> cdf[i] /= sum;
 }
 
-Blockchain::operator string() const{
-    // returns the hash as a string
-    string aux = this -> currentHash;
-    return aux;
+// GETTERS
+int ZipfSampler::getSize() const{
+    if (this -> cdf.empty())
+        return 0;
+    return this -> exponent == 0 ? int(this -> cdf[0]) : this -> cdf.size();
 }
 
 // utility functions
-bool Blockchain::validateTx(Transaction &tx, unordered_map<string, Wallet> &wallets){
-    // checks if a transaction is valid (considering correct amounts and nonces)
-    if (!tx.isMineable())
-        return false;
+int ZipfSampler::sample(Random &random) const{
+    if (this -> exponent == 0)
+        return random.range(0, int(this -> cdf[0]) - 1);
+    int index = lower_bound(this -> cdf.begin(), this -> cdf.end(), random.uniform()) - this -> cdf.begin();
+    return min(index, int(this -> cdf.size()) - 1);
+}
 
-    // check if wallet exists
-    if (wallets.find(tx.getFrom()) == wallets.end())
-        return false;
+class WorkloadGenerator{
+    // deterministic streams of transactions for benchmarks and headless runs
+    // the same settings (and seed) always produce the same addresses and the same transactions
+    public:
+        struct Distribution{
+            // uniform in [low, high], or exponential with the given mean cut to [low, high]
+            int low = 1, high = 1000;
+            bool exponential = false;
+            double mean = 0;
+
+            int sample(Random &random) const;
+        };
+
+        struct Settings{
+            unsigned long long seed = 1;
+            int accounts = 1000;            // generated addresses
+            int balance = 100000;           // starting balance of every generated address (1/100 coins)
+            double senderSkew = 0;          // zipf exponent of the senders (0 - uniform)
+            Distribution amount;
+            Distribution fee = {25, 500};
+            double nonceGapRate = 0;        // chance that a transaction skips a nonce (it stays stuck in the mempool)
+        };
+
+    private:
+        Settings settings;
+        Random random;
+        vector<Address> addresses;
+        vector<int> nextNonce;              // next nonce of every address (0 - ask the blockchain)
+        unordered_map<Address, int> indexOf;
+        ZipfSampler senders;
+        long long generated, accepted;
 
-    // check for overflow and verify if enough funds are available
-    if (tx.getAmount() + tx.getFee() < 0 || tx.getAmount() + tx.getFee() > wallets[tx.getFrom()].getBalance())
-        return false;
-        
-    // check nonce
-    if (tx.getNonce() < wallets[tx.getFrom()].getNonce() + 1 && tx.getNonce() != 0)
-        return false;
-    return true;
+    public:
+        // CONSTRUCTORS
+        WorkloadGenerator(const Settings &settings);
+
+        // utility functions
+        void addAccount(const Address &addr);
+        unordered_map<Address, Wallet> getWallets() const;
+        Transaction next(const Blockchain &bc);
+        Transaction next(Random &random, int producer, int producers);
+        int feed(Blockchain &bc, int count);
+        void resetNonces();
+        void syncNonces(const Blockchain &bc);
+
+        // GETTERS
+        const vector<Address>& getAddresses() const;
+        const Settings& getSettings() const;
+        long long getGenerated() const;
+        long long getAccepted() const;
+};
+
+int WorkloadGenerator::Distribution::sample(Random &random) const{
+    if (!this -> exponential)
+        return random.range(this -> low, this -> high);
+    double value = this -> low + random.exponential(max(this -> mean - this -> low, 1.0));
+    return value >= this -> high ? this -> high : int(value);
 }
 
-bool Blockchain::validateBlockTransactions(Block &bl){
-    // checks if the transactions from a block are valid
-    unordered_map<string, Wallet> walletsCopy = this -> wallets;
-    for (auto it = bl.getTransactions().begin(); it != bl.getTransactions().end(); it++){
-        Transaction tx = *it;
-        if (!validateTx(tx, walletsCopy) || tx.getNonce() != walletsCopy[tx.getFrom()].getNonce() + 1)
-            return false;
-        if (walletsCopy.find(tx.getTo()) == walletsCopy.end())
-            walletsCopy[tx.getTo()] = Wallet(tx.getTo(), 0);  // create a new wallet if the address is not in the map
-        
-        // simulate balance and nonce updates (this helps proposing valid blocks)
-        walletsCopy[tx.getFrom()].setBalance(walletsCopy[tx.getFrom()].getBalance() - tx.getAmount());
-        walletsCopy[tx.getTo()].setBalance(walletsCopy[tx.getTo()].getBalance() + tx.getAmount());
-        walletsCopy[tx.getFrom()].setNonce(walletsCopy[tx.getFrom()].getNonce() + 1);
+// CONSTRUCTORS
+WorkloadGenerator::WorkloadGenerator(const Settings &settings):settings(settings), random(settings.seed), generated(0), accepted(0){
+    // the addresses are random bytes, no hex strings are built
+    this -> addresses.reserve(settings.accounts);
+    for (int i = 0; i < settings.accounts; i++){
+        unsigned char bytes[24];
+        for (int j = 0; j < 24; j += 8){
+            unsigned long long word = this -> random.next();
+            memcpy(bytes + j, &word, 8);
+        }
+        this -> addAccount(Address(bytes));
     }
-    return true;
+    this -> senders = ZipfSampler(this -> addresses.size(), settings.senderSkew);
+}
 
+// GETTERS
+const vector<Address>& WorkloadGenerator::getAddresses() const{
+    return this -> addresses;
 }
 
-void Blockchain::applyBlockOnState(Block &bl){
-    // applies the transactions from a block on the wallets
-    // the transactions are validated before calling this function
-    for (auto it = bl.getTransactions().begin(); it != bl.getTransactions().end(); it++){
-        Transaction tx = *it;
-        if (wallets.find(tx.getTo()) == wallets.end())
-            this -> wallets[tx.getTo()] = Wallet(tx.getTo(), 0);  // create a new wallet if the address is not in the map
-        
-        // set balances and nonces
-        this -> wallets[tx.getFrom()].setBalance(wallets[tx.getFrom()].getBalance() - tx.getAmount() - tx.getFee());
-        this -> wallets[tx.getTo()].setBalance(wallets[tx.getTo()].getBalance() + tx.getAmount());
-        this -> wallets[tx.getFrom()]++;    // increments nonce
+const WorkloadGenerator::Settings& WorkloadGenerator::getSettings() const{
+    return this -> settings;
+}
 
-        // we modify the transaction pointer held in both wallets because we are going
-        // to move the tx from the mempool to a block (and the address will be modified)
-        this -> wallets[tx.getFrom()].updateTx(tx.getHash(), &*it);
-        if (tx.getTo() != tx.getFrom())     // avoid tx to self
-            this -> wallets[tx.getTo()].updateTx(tx.getHash(), &*it);
+long long WorkloadGenerator::getGenerated() const{
+    return this -> generated;
+}
 
-        // the tx has been mined
-        this -> mempool.deleteTx(tx.getHash());
-    }
+long long WorkloadGenerator::getAccepted() const{
+    return this -> accepted;
 }
 
-void Blockchain::processBlock(Block &bl){
-    // processes a block and adds it to the blockchain
-    if (bl.getHeight() != this -> currentHeight + 1){
-        sysMessage("The height of the new block is not consistent with the current height. The block was not processed.");
-        return;
-    }
-    if (bl.getParentHash() != this -> currentHash){
-        sysMessage("The parent hash of the new block does not match the hash of the current block. The block was not processed.");
-        return;
-    }
-    if (!this -> validateBlockTransactions(bl)){
-        sysMessage("Block contains invalid transactions and will not be processed.");
+// utility functions
+void WorkloadGenerator::addAccount(const Address &addr){
+    // extra accounts also send and receive (the most skewed senders are the first addresses)
+    if (this -> indexOf.count(addr))
         return;
+    this -> indexOf[addr] = this -> addresses.size();
+    this -> addresses.push_back(addr);
+    this -> nextNonce.push_back(0);
+    if (this -> senders.getSize() != 0)
+        this -> senders = ZipfSampler(this -> addresses.size(), this -> settings.senderSkew);
+}
+
+unordered_map<Address, Wallet> WorkloadGenerator::getWallets() const{
+    // the starting wallets (to be imported in the blockchain)
+    unordered_map<Address, Wallet> wallets;
+    wallets.reserve(this -> addresses.size());
+    for (auto it = this -> addresses.begin(); it != this -> addresses.end(); it++)
+        wallets.insert(make_pair(*it, Wallet(*it, this -> settings.balance)));
+    return wallets;
+}
+
+Transaction WorkloadGenerator::next(const Blockchain &bc){
+    // the next transaction of the stream (the nonce of the sender is not advanced until it is accepted)
+    int from = this -> senders.sample(this -> random);
+    int to = this -> random.range(0, this -> addresses.size() - 1);
+    int amount = this -> settings.amount.sample(this -> random);
+    int fee = this -> settings.fee.sample(this -> random);
+
+    if (this -> nextNonce[from] == 0)
+        this -> nextNonce[from] = bc.getAccountNonce(this -> addresses[from]) + 1;
+    int nonce = this -> nextNonce[from];
+    if (this -> settings.nonceGapRate > 0 && this -> random.uniform() < this -> settings.nonceGapRate)
+        nonce++;
+
+    this -> generated++;
+    return Transaction(this -> addresses[from], this -> addresses[to], amount, fee, nonce, false);
+}
+
+Transaction WorkloadGenerator::next(Random &random, int producer, int producers){
+    // the next transaction of one of several producer threads: each has its own random stream and its own senders
+    // (index % producers == producer), so no two threads touch the same nonce. nothing is read from the blockchain,
+    // the nonce of the sender advances right away (syncNonces corrects it between rounds)
+    int from = this -> senders.sample(random);
+    from += producer - from % producers;        // the sender next to it which belongs to this producer
+    if (from >= int(this -> addresses.size()))
+        from = producer;
+    int to = random.range(0, this -> addresses.size() - 1);
+    int amount = this -> settings.amount.sample(random);
+    int fee = this -> settings.fee.sample(random);
+
+    int nonce = max(this -> nextNonce[from], 1);
+    if (this -> settings.nonceGapRate > 0 && random.uniform() < this -> settings.nonceGapRate)
+        nonce++;
+    this -> nextNonce[from] = nonce + 1;
+
+    return Transaction(this -> addresses[from], this -> addresses[to], amount, fee, nonce, false);
+}
+
+int WorkloadGenerator::feed(Blockchain &bc, int count){
+    // sends count transactions to the blockchain, returns how many reached the mempool
+    int sent = 0;
+    for (int i = 0; i < count; i++){
+        Transaction tx = this -> next(bc);
+        bc.sendTx(tx);
+        if (!bc.getMempool().hasTx(tx.getHash()))
+            continue;
+        this -> nextNonce[this -> indexOf[tx.getFrom()]] = tx.getNonce() + 1;
+        sent++;
     }
+    this -> accepted += sent;
+    return sent;
+}
 
-    this -> blocks.push_back(bl);
-    this -> applyBlockOnState(this -> blocks.back());   // we apply the block which was copied into the blockchain
-                                                        // for proper references to the transactions
-    this -> setCurrentHeight(this -> currentHeight + 1);
-    this -> setCurrentHash((char*)bl.getHash().c_str());
-    this -> updateStatistics(bl);
-    this -> cleanMempool();
-    this -> cleanWallets();
+void WorkloadGenerator::resetNonces(){
+    // the next transactions continue from the nonces of the blockchain (e.g. after the mempool dropped transactions)
+    fill(this -> nextNonce.begin(), this -> nextNonce.end(), 0);
 }
 
-void Blockchain::updateStatistics(Block& bl){
-    // updates the statistics of the blockchain after a new block is added
-    // does an arithmetic mean of all spends in all blocks
-
-    // copy the old array
-    float *aux = new float[this -> currentHeight + 1];
-    if (this -> txStats)
-        for (int i = 1; i <= this -> currentHeight - 1; i++)
-            aux[i] = this -> txStats[i];
-    
-    // calculate the sum of the transactions in the new block
-    aux[this -> currentHeight] = 0;
-    for (auto it = bl.getTransactions().begin(); it != bl.getTransactions().end(); it++){
-        aux[this -> currentHeight] += (*it).getAmount();
+void WorkloadGenerator::syncNonces(const Blockchain &bc){
+    // the next nonce of every sender follows its committed nonce and the transactions it has in the mempool
+    for (size_t i = 0; i < this -> addresses.size(); i++){
+        int nonce = bc.getAccountNonce(this -> addresses[i]);
+        const Mempool::NonceQueue *queue = bc.getMempool().getSenderQueue(this -> addresses[i]);
+        if (queue && !queue -> empty())
+            nonce = max(nonce, queue -> rbegin() -> first);
+        this -> nextNonce[i] = nonce + 1;
     }
-    if (aux[this -> currentHeight] != 0)
-        aux[this -> currentHeight] /= bl.getTransactions().size();
+}
 
-    // delete old array
-    if (this -> txStats)
-        delete[] this -> txStats;
-    this -> txStats = aux;
+// ----------------- HEADLESS DRIVER -----------------
+
+class HeadlessDriver{
+    // runs a scenario file without the menu and reports how fast it went
+    // scenario lines are "key value(s)", '#' starts a comment:
+    //   seed 42                  seed of the workload generator
+    //   wallets 1000 50000       generated wallets and the balance of each (1/100 coins)
+    //   wallet 0x... 50000       a wallet with a given address (it also sends and receives)
+    //   blocks 100               number of blocks to mine
+    //   txPerBlock 500           transactions sent between two mining rounds
+    //   mineEvery 1              a block is mined after this many rounds of transactions
+    //   amount 1 1000 [exp 200]  range of the amounts (1/100 coins), uniform or exponential with a mean
+    //   fee 25 500 [exp 60]      range of the fees (1/100 coins), uniform or exponential with a mean
+    //   senderSkew 1.1           zipf exponent of the senders (0 - uniform)
+    //   nonceGaps 0.01           fraction of transactions which skip a nonce
+    //   mempool 100000           maximum size of the mempool
+    //   workers 4                block validation threads
+    //   history off              keep the tx history of the wallets (on / off)
+    //   pipeline on              finish every block on a worker thread while the next one is prepared (on / off)
+    //   producers 4              threads submitting the transactions through a TxIngestor (0 - sent by the driver)
+    //   walletRetention 10       blocks an empty wallet is kept (0 - removed after the next block, -1 - never removed)
+    //   log chain.log            append the blocks to a block log
+    //   snapshot state.snap 100  save the state every 100 blocks
+    //   stats 1000 100           block statistics kept in detail (0 - all) and blocks per downsampled point (0 - none)
+    // the scenario can also assert on its result, the run fails (exit code 1) if one of these does not hold:
+    //   batch 0x... 0x... 10 30 1   a transaction (from, to, amount, fee, nonce) sent with sendTxBatch before the first round
+    //   expect statuses AABD        statuses returned for the batch
+    //   expect hash 0x...           hash of the last block
+    //   expect height 100           height of the last block
+    //   check mempool               the mempool indexes match its transactions
+    //   check accounts              every second account is erased from a copy of the account store, the rest is still found
+    //   check merkle                every transaction of the kept blocks has a valid inclusion proof
+    //   check log                   a block log of the kept blocks with a torn record appended is cut back to the last block
+    //   check snapshot              a snapshot loaded in a new blockchain has the same height, hash and accounts
+    struct Scenario{
+        WorkloadGenerator::Settings workload;
+        vector<pair<Address, int>> wallets;
+        int blocks = 10;
+        int txPerBlock = 100;
+        int mineEvery = 1;
+        int mempoolSize = 1024;
+        int workers = 0;            // 0 - default (one per core)
+        bool history = true;
+        bool pipeline = false;
+        int producers = 0;
+        int walletRetention = 0;
+        string logPath;
+        string snapshotPath;
+        int snapshotInterval = 0;
+        int statsRetention = 0;
+        int statsBucketSize = 0;
+        vector<Transaction> batch;
+        string expectStatuses;
+        string expectHash;
+        int expectHeight = -1;      // -1 - not checked
+        vector<string> checks;
+    };
 
-    double sum = 0;
-    for (int i = 1; i <= this -> currentHeight; i++)
-        sum += this -> txStats[i];
-    this -> setAverageTransacted(sum / this -> currentHeight);
-}
+    Scenario scenario;
+    Blockchain bc;
 
-void Blockchain::generateGenesis(){
-    // generates the genesis block of the blockchain
-    // this block is special 
-    if (this -> status != 'I'){
-        sysMessage("The blockchain is not in initializing state. The genesis block was not generated.");
-        return;
-    }
+    // results
+    long long txSent, txAccepted, txMined;
+    int blocksMined;
+    double seconds;
+    string batchStatuses;
+    int checksPassed, checksFailed;
 
-    // generate the first block
-    Block genesisBlock("0xdeadbeef", 0);    // parent hash is a special value (usually random)
-    this -> blocks.push_back(genesisBlock);
+    static bool readDistribution(istream &fields, WorkloadGenerator::Distribution &dist);
+    static long long peakMemoryKb();
+    void feedConcurrently(WorkloadGenerator &workload, TxIngestor &ingestor, int round);
+    bool checkAccounts() const;
+    bool checkMerkle() const;
+    bool checkLog() const;
+    bool checkSnapshot() const;
 
-    // generate the god wallet
-    Wallet godWallet(Transaction::getGodAddress(), 100000);
-    this -> wallets[Transaction::getGodAddress()] = godWallet;
+    public:
+        // CONSTRUCTORS
+        HeadlessDriver();
 
-    // set the remaining fields for the blockchain
-    this -> currentHeight = 0;
-    this -> setCurrentHash((char*)genesisBlock.getHash().c_str());
-    this -> setStatus('A');
+        // utility functions
+        bool loadScenario(const string &path);
+        bool run();
+        bool verify();
+        void writeSummary(ostream &out) const;
+};
+
+// CONSTRUCTORS
+HeadlessDriver::HeadlessDriver():txSent(0), txAccepted(0), txMined(0), blocksMined(0), seconds(0), checksPassed(0), checksFailed(0) {}
+
+// utility functions
+bool HeadlessDriver::readDistribution(istream &fields, WorkloadGenerator::Distribution &dist){
+    // "low high" or "low high exp mean"
+    if (!(fields >> dist.low >> dist.high) || dist.low < 0 || dist.low > dist.high)
+        return false;
+    string kind;
+    dist.exponential = bool(fields >> kind);
+    if (!dist.exponential)
+        return true;
+    return kind == "exp" && fields >> dist.mean && dist.mean >= dist.low;
 }
 
-void Blockchain::sendTx(Transaction &tx){
-    // sends a transaction to the mempool
-    if (!validateTx(tx, this -> wallets)){
-        sysMessage("The transaction is invalid. It will not be added to the mempool.");
-        return;
+bool HeadlessDriver::loadScenario(const string &path){
+    ifstream in(path);
+    if (!in){
+        sysMessage("The scenario " + path + " could not be opened.");
+        return false;
     }
-    this -> mempool.addTx(tx);
-
-    // we also register the tx in the respective wallets
-    this -> wallets[tx.getFrom()].addTx(&this -> mempool.getTxList().back());
 
-    // if the "to" wallet does not exist, create it
-    if (this -> wallets.find(tx.getTo()) == this -> wallets.end())
-        this -> wallets[tx.getTo()] = Wallet(tx.getTo(), 0);
+    string line;
+    int lineNumber = 0;
+    while (getline(in, line)){
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        istringstream fields(line);
+        string key;
+        if (!(fields >> key))
+            continue;
 
-    if (tx.getTo() != tx.getFrom())     // avoid tx to self
-        this -> wallets[tx.getTo()].addTx(&this -> mempool.getTxList().back());
+        Scenario &sc = this -> scenario;
+        bool ok = true;
+        if (key == "seed") ok = bool(fields >> sc.workload.seed);
+        else if (key == "wallets") ok = fields >> sc.workload.accounts >> sc.workload.balance && sc.workload.accounts >= 0;
+        else if (key == "wallet"){
+            string address;
+            int balance;
+            ok = fields >> address >> balance && isAddress(address);
+            if (ok)
+                sc.wallets.push_back(make_pair(Address(address), balance));
+        }
+        else if (key == "blocks") ok = bool(fields >> sc.blocks);
+        else if (key == "txPerBlock") ok = bool(fields >> sc.txPerBlock);
+        else if (key == "mineEvery") ok = fields >> sc.mineEvery && sc.mineEvery > 0;
+        else if (key == "amount") ok = readDistribution(fields, sc.workload.amount);
+        else if (key == "fee") ok = readDistribution(fields, sc.workload.fee) && sc.workload.fee.low > 0;
+        else if (key == "senderSkew") ok = fields >> sc.workload.senderSkew && sc.workload.senderSkew >= 0;
+        else if (key == "nonceGaps") ok = fields >> sc.workload.nonceGapRate && sc.workload.nonceGapRate >= 0 && sc.workload.nonceGapRate < 1;
+        else if (key == "mempool") ok = fields >> sc.mempoolSize && sc.mempoolSize > 0;
+        else if (key == "workers") ok = fields >> sc.workers && sc.workers > 0;
+        else if (key == "history"){
+            string value;
+            ok = fields >> value && (value == "on" || value == "off");
+            sc.history = value == "on";
+        }
+        else if (key == "producers") ok = fields >> sc.producers && sc.producers >= 0;
+        else if (key == "pipeline"){
+            string value;
+            ok = fields >> value && (value == "on" || value == "off");
+            sc.pipeline = value == "on";
+        }
+        else if (key == "walletRetention") ok = fields >> sc.walletRetention && sc.walletRetention >= keepEmptyWallets;
+        else if (key == "log") ok = bool(fields >> sc.logPath);
+        else if (key == "snapshot") ok = fields >> sc.snapshotPath >> sc.snapshotInterval && sc.snapshotInterval > 0;
+        else if (key == "stats"){
+            ok = fields >> sc.statsRetention && sc.statsRetention >= 0;
+            if (ok && !(fields >> sc.statsBucketSize))
+                sc.statsBucketSize = 0;
+            ok = ok && sc.statsBucketSize >= 0;
+        }
+        else if (key == "batch"){
+            string from, to;
+            int amount, fee, nonce;
+            ok = fields >> from >> to >> amount >> fee >> nonce && isAddress(from) && isAddress(to);
+            if (ok)
+                sc.batch.push_back(Transaction(Address(from), Address(to), amount, fee, nonce, false));
+        }
+        else if (key == "expect"){
+            string what;
+            ok = bool(fields >> what);
+            if (what == "statuses") ok = ok && fields >> sc.expectStatuses;
+            else if (what == "hash") ok = ok && fields >> sc.expectHash;
+            else if (what == "height") ok = ok && fields >> sc.expectHeight && sc.expectHeight >= 0;
+            else ok = false;
+        }
+        else if (key == "check"){
+            string what;
+            ok = fields >> what && (what == "mempool" || what == "accounts" || what == "merkle" || what == "log" || what == "snapshot");
+            if (ok)
+                sc.checks.push_back(what);
+        }
+        else ok = false;
 
-    this -> mempool.updateAverageFee();
+        if (!ok){
+            sysMessage("Line " + to_string(lineNumber) + " of the scenario is not valid: " + line);
+            return false;
+        }
+    }
+    return true;
 }
 
-Block Blockchain::proposeBlock(){
-    // proposes a new block to be added to the blockchain
-    // the block is proposed based on the transactions in the mempool
-    if (this -> mempool.getTxList().empty()){
-        info("The mempool is empty. Empty block was generated.");
-        return Block(this -> currentHash, this -> currentHeight + 1);
+long long HeadlessDriver::peakMemoryKb(){
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;     // kilobytes on linux
+#endif
+}
+
+void HeadlessDriver::feedConcurrently(WorkloadGenerator &workload, TxIngestor &ingestor, int round){
+    // the transactions of a round are generated and submitted by the producer threads, the round ends when
+    // the ingestor has sent all of them to the blockchain
+    const Scenario &sc = this -> scenario;
+    int producers = min<int>(sc.producers, workload.getAddresses().size());
+    vector<thread> threads;
+    for (int p = 0; p < producers; p++)
+        threads.push_back(thread([&, p]{
+            Random random(sc.workload.seed ^ ((unsigned long long)round << 20 | p));
+            for (int i = p; i < sc.txPerBlock; i += producers)
+                ingestor.submit(workload.next(random, p, producers));
+        }));
+    for (auto it = threads.begin(); it != threads.end(); it++)
+        (*it).join();
+    ingestor.flush();
+}
+
+bool HeadlessDriver::run(){
+    const Scenario &sc = this -> scenario;
+    srand(sc.workload.seed);
+    quietMessages = true;
+
+    // setup (not measured)
+    this -> bc.setTrackHistory(sc.history);
+    this -> bc.setWalletRetention(sc.walletRetention);
+    this -> bc.setPipelined(sc.pipeline);
+    if (sc.workers > 0)
+        this -> bc.setValidationWorkers(sc.workers);
+    this -> bc.generateGenesis();
+    this -> bc.setMempool(Mempool(list<Transaction>(), sc.mempoolSize));
+
+    WorkloadGenerator workload(sc.workload);
+    unordered_map<Address, Wallet> wallets = workload.getWallets();
+    for (auto it = sc.wallets.begin(); it != sc.wallets.end(); it++){
+        workload.addAccount(it -> first);
+        wallets.insert_or_assign(it -> first, Wallet(it -> first, it -> second));
+    }
+    wallets.insert_or_assign(Transaction::getGodAddress(), this -> bc.getWallet(Transaction::getGodAddress()));
+    this -> bc.importWallets(wallets);
+    if (workload.getAddresses().empty()){
+        quietMessages = false;
+        sysMessage("The scenario has no wallets.");
+        return false;
     }
 
-    list<Transaction> txList = this -> mempool.getTxList();
-    // we sort the mempool such that we can process the transaction in the order of their nonce
-    // otherwise, some transactions would end up being mined separately
-    // some more complex logic could be added to process transactions based on money flow to further optimize this process
-    txList.sort();
-    
-    unordered_map<string, Wallet> walletsCopy = this -> wallets;
-    Block newBlock(this -> currentHash, this -> currentHeight + 1);
-    for (auto it = txList.begin(); it != txList.end(); it++){
-        Transaction tx = *it;
-        if (validateTx(tx, walletsCopy) && tx.getNonce() == walletsCopy[tx.getFrom()].getNonce() + 1){
-            tx.setIsMined(true);
-            newBlock.addTx(tx);
+    this -> bc.setStatsRetention(sc.statsRetention, sc.statsBucketSize);
+    if (!sc.logPath.empty() && !this -> bc.openBlockLog(sc.logPath)){
+        quietMessages = false;
+        sysMessage("The block log of the scenario could not be opened.");
+        return false;
+    }
+    if (sc.snapshotInterval > 0)
+        this -> bc.setSnapshots(sc.snapshotPath, sc.snapshotInterval);
+    if (!sc.batch.empty()){
+        vector<char> statuses = this -> bc.sendTxBatch(sc.batch);
+        this -> batchStatuses.assign(statuses.begin(), statuses.end());
+    }
+
+    // with producers the transactions go through the concurrent ingestion path
+    TxIngestor *ingestor = NULL;
+    if (sc.producers > 0){
+        ingestor = new TxIngestor(this -> bc);
+        workload.syncNonces(this -> bc);
+    }
+
+    // the measured part: only transactions and blocks, no console output
+    auto start = chrono::steady_clock::now();
+    for (int round = 1; this -> blocksMined < sc.blocks; round++){
+        if (ingestor)
+            this -> feedConcurrently(workload, *ingestor, round);
+        else
+            workload.feed(this -> bc, sc.txPerBlock);
+        if (round % sc.mineEvery != 0)
+            continue;
 
-            // we simulate balance updates to produce a valid block
-            walletsCopy[tx.getFrom()].setBalance(walletsCopy[tx.getFrom()].getBalance() - tx.getAmount());
-            walletsCopy[tx.getTo()].setBalance(walletsCopy[tx.getTo()].getBalance() + tx.getAmount());
-            walletsCopy[tx.getFrom()].setNonce(walletsCopy[tx.getFrom()].getNonce() + 1);
+        unique_lock<mutex> guard;
+        if (ingestor)
+            guard = unique_lock<mutex>(ingestor -> getChainLock());
+        Block bl = this -> bc.proposeBlock();
+        int height = this -> bc.getCurrentHeight();
+        this -> bc.processBlock(bl);
+        if (this -> bc.getCurrentHeight() != height + 1){
+            quietMessages = false;
+            sysMessage("Block " + to_string(height + 1) + " could not be processed. The scenario was stopped.");
+            if (guard)
+                guard.unlock();
+            delete ingestor;
+            return false;
         }
-        else warning("Transaction skipped.");
+        this -> blocksMined++;
+        this -> txMined += bl.getTransactions().size();
+
+        // senders whose transactions were dropped from the mempool continue from their committed nonce
+        if (ingestor)
+            workload.syncNonces(this -> bc);
+        else if (this -> bc.getMempool().getTxList().empty())
+            workload.resetNonces();
     }
+    this -> bc.flushPipeline();     // the last block is part of the measurement
+    this -> seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    this -> txSent = ingestor ? ingestor -> getSubmitted() : workload.getGenerated();
+    this -> txAccepted = ingestor ? ingestor -> getAccepted() : workload.getAccepted();
+    delete ingestor;
 
-    return newBlock;
+    quietMessages = false;
+    return true;
 }
 
-int Blockchain::getAccountNonce(string addr){
-    // returns the nonce of an account
-    return this -> wallets[addr].getNonce();
+bool HeadlessDriver::checkAccounts() const{
+    // erases every second account from a copy of the store (the table entries after them are shifted back)
+    // and looks all of them up again
+    const AccountStore &committed = this -> bc.getAccounts();
+    AccountStore store = committed;
+    for (int i = 0; i < committed.getSize(); i += 2)
+        if (!store.erase(committed.getAddress(i)))
+            return false;
+    for (int i = 0; i < committed.getSize(); i++){
+        int index = store.find(committed.getAddress(i));
+        bool erased = i % 2 == 0;
+        if (erased != (index == -1))
+            return false;
+        if (!erased && (store.getBalance(index) != committed.getBalance(i) || store.getNonce(index) != committed.getNonce(i)))
+            return false;
+    }
+    return store.getSize() == committed.getSize() / 2;
+}
+
+bool HeadlessDriver::checkMerkle() const{
+    // every transaction has to be proven against the root of its block, and a proof must not fit another transaction
+    for (auto bl = this -> bc.getBlocks().begin(); bl != this -> bc.getBlocks().end(); bl++){
+        const vector<TxRef> &txs = (*bl).getTransactions();
+        for (size_t i = 0; i < txs.size(); i++){
+            MerkleTree::Proof proof;
+            if (!(*bl).getProof(txs[i] -> getHash(), proof) || !MerkleTree::verifyProof(txs[i] -> getHash(), proof, (*bl).getMerkleRoot()))
+                return false;
+            const Hash &other = txs[(i + 1) % txs.size()] -> getHash();
+            if (other != txs[i] -> getHash() && MerkleTree::verifyProof(other, proof, (*bl).getMerkleRoot()))
+                return false;
+        }
+    }
+    return true;
 }
 
-Transaction Blockchain::readTx(){
-    // reads a tx from the console and sets the nonce if necessary
-    Transaction tx;
-    cin >> tx;
+bool HeadlessDriver::checkLog() const{
+    // the kept blocks are written in a temporary log, then a torn record is appended and the log is opened again
+    error_code error;
+    string path = (filesystem::temp_directory_path(error) / "blockchain-simulator-check.log").string();
+    filesystem::remove(path, error);
+    BlockLog log;
+    bool ok = log.open(path);
+    for (auto it = this -> bc.getBlocks().begin(); ok && it != this -> bc.getBlocks().end(); it++)
+        ok = log.append(*it);
+    log.close();
+    size_t size = filesystem::file_size(path, error);
+
+    // a record which says it has 100 bytes, but only 5 of them were written
+    if (ok){
+        ofstream out(path, ios::binary | ios::app);
+        const char torn[9] = {100, 0, 0, 0, 1, 2, 3, 4, 5};
+        out.write(torn, sizeof(torn));
+    }
 
-    if (tx.getNonce() != 0)
-        return tx;
+    Block last;
+    ok = ok && log.open(path) && log.getLastHeight() == this -> bc.getCurrentHeight() && filesystem::file_size(path, error) == size &&
+         log.readByHeight(log.getLastHeight(), last) && last.getHash() == this -> bc.getCurrentHash() && log.readByHash(last.getHash(), last);
+    log.close();
+    filesystem::remove(path, error);
+    return ok;
+}
+
+bool HeadlessDriver::checkSnapshot() const{
+    // saves the state in a temporary file and loads it in a new blockchain
+    error_code error;
+    string path = (filesystem::temp_directory_path(error) / "blockchain-simulator-check.snap").string();
+    Blockchain loaded;
+    bool ok = this -> bc.saveSnapshot(path) && loaded.loadSnapshot(path) &&
+              loaded.getCurrentHeight() == this -> bc.getCurrentHeight() &&
+              string(loaded.getCurrentHash()) == this -> bc.getCurrentHash();
+    filesystem::remove(path, error);
+
+    const AccountStore &accounts = this -> bc.getAccounts(), &loadedAccounts = loaded.getAccounts();
+    ok = ok && loadedAccounts.getSize() == accounts.getSize();
+    for (int i = 0; ok && i < accounts.getSize(); i++){
+        int index = loadedAccounts.find(accounts.getAddress(i));
+        ok = index != -1 && loadedAccounts.getBalance(index) == accounts.getBalance(i) &&
+             loadedAccounts.getNonce(index) == accounts.getNonce(i);
+    }
+    return ok;
+}
 
-    if (this -> wallets.find(tx.getFrom()) == this -> wallets.end()){
-        warning("The sender of the transaction does not exist.");
-        tx.setNonce(1);
-        return tx;
+bool HeadlessDriver::verify(){
+    // runs the checks and compares the expected values of the scenario, every failure is reported
+    const Scenario &sc = this -> scenario;
+    vector<string> failed;
+    auto expect = [&](bool ok, const string &what){
+        ok ? this -> checksPassed++ : this -> checksFailed++;
+        if (!ok)
+            failed.push_back(what);
+    };
+
+    quietMessages = true;
+    if (!sc.batch.empty() && !sc.expectStatuses.empty())
+        expect(this -> batchStatuses == sc.expectStatuses, "the batch statuses are " + this -> batchStatuses + ", not " + sc.expectStatuses);
+    if (!sc.expectHash.empty())
+        expect(sc.expectHash == this -> bc.getCurrentHash(), "the hash is " + string(this -> bc.getCurrentHash()) + ", not " + sc.expectHash);
+    if (sc.expectHeight != -1)
+        expect(sc.expectHeight == this -> bc.getCurrentHeight(), "the height is " + to_string(this -> bc.getCurrentHeight()) +
+                                                                 ", not " + to_string(sc.expectHeight));
+    for (auto it = sc.checks.begin(); it != sc.checks.end(); it++){
+        bool ok = false;
+        if (*it == "mempool") ok = this -> bc.getMempool().checkIndexes();
+        else if (*it == "accounts") ok = this -> checkAccounts();
+        else if (*it == "merkle") ok = this -> checkMerkle();
+        else if (*it == "log") ok = this -> checkLog();
+        else if (*it == "snapshot") ok = this -> checkSnapshot();
+        expect(ok, "check " + *it + " failed");
+    }
+    quietMessages = false;
+
+    for (auto it = failed.begin(); it != failed.end(); it++)
+        sysMessage("Scenario assertion not met: " + *it + ".");
+    return failed.empty();
+}
+
+void HeadlessDriver::writeSummary(ostream &out) const{
+    // one JSON object, so scripts can compare runs
+    double elapsed = max(this -> seconds, 1e-9);
+    out << fixed << setprecision(3);
+    out << "{\"blocks\": " << this -> blocksMined
+        << ", \"tx_sent\": " << this -> txSent
+        << ", \"tx_accepted\": " << this -> txAccepted
+        << ", \"tx_mined\": " << this -> txMined
+        << ", \"seconds\": " << this -> seconds
+        << ", \"tx_per_s\": " << this -> txMined / elapsed
+        << ", \"blocks_per_s\": " << this -> blocksMined / elapsed
+        << ", \"peak_memory_kb\": " << peakMemoryKb()
+        << ", \"messages\": " << suppressedMessages.load()
+        << ", \"checks_passed\": " << this -> checksPassed
+        << ", \"checks_failed\": " << this -> checksFailed
+        << ", \"height\": " << this -> bc.getCurrentHeight()
+        << ", \"hash\": \"" << this -> bc.getCurrentHash() << "\"}" << endl;
+}
+
+int runHeadless(const string &scenarioPath, const string &summaryPath){
+    // entry point of --headless, returns the exit code of the program
+    // the summary is written even if an assertion of the scenario was not met
+    HeadlessDriver driver;
+    if (!driver.loadScenario(scenarioPath) || !driver.run())
+        return 1;
+    bool passed = driver.verify();
+
+    if (summaryPath.empty()){
+        driver.writeSummary(cout);
+        return passed ? 0 : 1;
+    }
+    ofstream out(summaryPath);
+    if (!out){
+        sysMessage("The summary could not be written in " + summaryPath + ".");
+        return 1;
     }
+    driver.writeSummary(out);
+    return passed ? 0 : 1;
+}
+
+// ----------------- BENCHMARKS -----------------
+
+class BenchmarkSuite{
+    // microbenchmarks of the hot paths, each one measured for every mempool size and wallet count
+    // reports ns/op and allocations/op, reading a row of sizes shows how an operation scales
+    struct Result{
+        string name;
+        int mempoolSize;
+        int walletCount;
+        long long ops;
+        double nsPerOp;
+        double allocsPerOp;         // -1 if allocations are not counted
+    };
 
-    tx.setNonce(this -> wallets[tx.getFrom()].getNonce() + 1);
-    tx.updateHash();
+    vector<int> mempoolSizes;
+    vector<int> walletCounts;
+    vector<Result> results;
 
-    return tx;
-}
+    template <class Body> void measure(const string &name, int mempoolSize, int walletCount, long long ops, Body body);
+    static Blockchain makeChain(WorkloadGenerator &workload, int mempoolSize);
+    void benchHashing(int mempoolSize);
+    void benchMempool(int mempoolSize);
+    void benchBlockchain(int mempoolSize, int walletCount);
 
-void Blockchain::cleanMempool(){
-    // this functions drops old transactions from the mempool
-    // if the nonce of an account is higher than a transaction in the mempool, it is dropped
-    list<Transaction> txList = this -> mempool.getTxList();
-    for (auto it = txList.begin(); it != txList.end(); it++){
-        if ((*it).getNonce() <= this -> getAccountNonce((*it).getFrom())){
-            // delete from wallets
-            this -> wallets[(*it).getFrom()].deleteTx((*it).getHash());
-            this -> wallets[(*it).getTo()].deleteTx((*it).getHash());
+    public:
+        // CONSTRUCTORS
+        BenchmarkSuite(const vector<int> &mempoolSizes, const vector<int> &walletCounts);
 
-            // delete from the mempool
-            this -> mempool.deleteTx((*it).getHash());
-        }
+        // utility functions
+        void run();
+        void writeReport(ostream &out) const;
+};
+
+// CONSTRUCTORS
+BenchmarkSuite::BenchmarkSuite(const vector<int> &mempoolSizes, const vector<int> &walletCounts):mempoolSizes(mempoolSizes),
+                                                                                                  walletCounts(walletCounts) {}
+
+// utility functions
+template <class Body>
+void BenchmarkSuite::measure(const string &name, int mempoolSize, int walletCount, long long ops, Body body){
+    // runs body once (it performs ops operations), the setup has to be done before
+#ifdef COUNT_ALLOCATIONS
+    long long allocations = allocationCount.load();
+#endif
+    auto start = chrono::steady_clock::now();
+    body();
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    ops = max(ops, 1LL);
+#ifdef COUNT_ALLOCATIONS
+    allocations = allocationCount.load() - allocations;
+    this -> results.push_back({name, mempoolSize, walletCount, ops, ns / ops, double(allocations) / ops});
+#else
+    this -> results.push_back({name, mempoolSize, walletCount, ops, ns / ops, -1});     // not counted
+#endif
+}
+
+Blockchain BenchmarkSuite::makeChain(WorkloadGenerator &workload, int mempoolSize){
+    // a chain with the workload's wallets and a full mempool
+    Blockchain bc;
+    bc.generateGenesis();
+    bc.setMempool(Mempool(list<Transaction>(), mempoolSize));
+    bc.importWallets(workload.getWallets());
+    while (int(bc.getMempool().getTxList().size()) < mempoolSize)
+        if (workload.feed(bc, mempoolSize - bc.getMempool().getTxList().size()) == 0)
+            break;
+    return bc;
+}
+
+void BenchmarkSuite::benchHashing(int count){
+    volatile unsigned long long sink = 0;
+
+    this -> measure("hashFunc", count, 0, count, [&](){
+        unsigned long long hash = 0;
+        for (int i = 0; i < count; i++)
+            hashFunc(hash, i);
+        sink = hash;
+    });
+
+    Transaction tx(Transaction::getGodAddress(), Address(string("0x1111111111111111111111111111111111111111")), 100, 1, 50);
+    this -> measure("Transaction::calculateHash", count, 0, count, [&](){
+        for (int i = 0; i < count; i++)
+            sink = sink + tx.calculateHash().getValue();
+    });
+}
+
+void BenchmarkSuite::benchMempool(int mempoolSize){
+    WorkloadGenerator::Settings settings;
+    settings.accounts = max(1, mempoolSize / 4);
+    WorkloadGenerator workload(settings);
+    Blockchain empty;
+    vector<Transaction> txs;
+    txs.reserve(mempoolSize);
+    for (int i = 0; i < mempoolSize; i++)
+        txs.push_back(workload.next(empty));
+
+    Mempool mempool(list<Transaction>(), mempoolSize);
+    this -> measure("Mempool::addTx", mempoolSize, 0, mempoolSize, [&](){
+        for (auto it = txs.begin(); it != txs.end(); it++)
+            mempool.addTx(*it);
+    });
+    this -> measure("Mempool::deleteTx", mempoolSize, 0, mempoolSize, [&](){
+        for (auto it = txs.begin(); it != txs.end(); it++)
+            mempool.deleteTx((*it).getHash());
+    });
+}
+
+void BenchmarkSuite::benchBlockchain(int mempoolSize, int walletCount){
+    WorkloadGenerator::Settings settings;
+    settings.accounts = walletCount;
+    WorkloadGenerator workload(settings);
+    Blockchain bc = makeChain(workload, mempoolSize);
+
+    // validation of the transactions in the mempool against the current state
+    const list<TxRef> &pending = bc.getMempool().getTxList();
+    StateOverlay state(bc.getAccounts());
+    int valid = 0;
+    this -> measure("Blockchain::validateTx", mempoolSize, walletCount, pending.size(), [&](){
+        for (auto it = pending.begin(); it != pending.end(); it++)
+            valid += bc.validateTx(**it, state);
+    });
+
+    Block bl;
+    this -> measure("Blockchain::proposeBlock (per tx)", mempoolSize, walletCount, pending.size(), [&](){
+        bl = bc.proposeBlock();
+    });
+    this -> measure("Blockchain::processBlock (per tx)", mempoolSize, walletCount, bl.getTransactions().size(), [&](){
+        bc.processBlock(bl);
+    });
+
+    // the same transactions sent one by one and as a batch, each on a chain with an empty mempool
+    Blockchain one, batch;
+    for (Blockchain *chain : {&one, &batch}){
+        chain -> generateGenesis();
+        chain -> setMempool(Mempool(list<Transaction>(), mempoolSize));
+        chain -> importWallets(workload.getWallets());
+    }
+    workload.syncNonces(one);
+    Random random(workload.getSettings().seed);
+    vector<Transaction> txs;
+    for (int i = 0; i < mempoolSize; i++)
+        txs.push_back(workload.next(random, 0, 1));
+    this -> measure("Blockchain::sendTx", mempoolSize, walletCount, txs.size(), [&](){
+        for (auto it = txs.begin(); it != txs.end(); it++)
+            one.sendTx(*it);
+    });
+    this -> measure("Blockchain::sendTxBatch (per tx)", mempoolSize, walletCount, txs.size(), [&](){
+        batch.sendTxBatch(txs);
+    });
+
+    // the cleanups are measured on a fresh chain, on their own
+    Blockchain dirty = makeChain(workload, mempoolSize);
+    this -> measure("Blockchain::cleanMempool (per tx)", mempoolSize, walletCount, mempoolSize, [&](){
+        dirty.cleanMempool();
+    });
+
+    // none of the imported wallets has transactions yet, so the sweep examines (and removes) every one of them
+    Blockchain idle;
+    idle.generateGenesis();
+    idle.importWallets(workload.getWallets());
+    this -> measure("Blockchain::cleanWallets (per wallet)", mempoolSize, walletCount, walletCount, [&](){
+        idle.cleanWallets();
+    });
+}
+
+void BenchmarkSuite::run(){
+    quietMessages = true;
+    for (auto size = this -> mempoolSizes.begin(); size != this -> mempoolSizes.end(); size++){
+        this -> benchHashing(*size);
+        this -> benchMempool(*size);
+        for (auto wallets = this -> walletCounts.begin(); wallets != this -> walletCounts.end(); wallets++)
+            this -> benchBlockchain(*size, *wallets);
+    }
+    quietMessages = false;
+}
+
+void BenchmarkSuite::writeReport(ostream &out) const{
+    // one row per benchmark and size, ordered by benchmark so the scaling can be read top to bottom
+    vector<Result> sorted = this -> results;
+    stable_sort(sorted.begin(), sorted.end(), [](const Result &a, const Result &b){ return a.name < b.name; });
+
+    out << left << setw(40) << "benchmark" << right << setw(10) << "mempool" << setw(10) << "wallets"
+        << setw(12) << "ops" << setw(14) << "ns/op" << setw(14) << "allocs/op" << endl;
+    out << fixed;
+    for (auto it = sorted.begin(); it != sorted.end(); it++){
+        out << left << setw(40) << (*it).name << right << setw(10) << (*it).mempoolSize << setw(10) << (*it).walletCount
+            << setw(12) << (*it).ops << setw(14) << setprecision(1) << (*it).nsPerOp;
+        if ((*it).allocsPerOp < 0)
+            out << setw(14) << "-" << endl;     // built without COUNT_ALLOCATIONS
+        else
+            out << setw(14) << setprecision(2) << (*it).allocsPerOp << endl;
     }
 }
 
-void Blockchain::cleanWallets(){
-    // removes wallets that have no transactions (god wallet is excluded)
-    for (auto it = this -> wallets.begin(); it != this -> wallets.end();){
-        if ((*it).second.getTxList().empty() && (*it).first != Transaction::getGodAddress())
-            it = this -> wallets.erase(it);
-        else it++;
-    }
+int runBenchmarks(bool quick){
+    // entry point of --bench (--bench quick uses smaller sizes)
+    vector<int> sizes = quick ? vector<int>{1000, 10000} : vector<int>{1000, 10000, 100000};
+    BenchmarkSuite suite(sizes, sizes);
+    suite.run();
+    suite.writeReport(cout);
+    return 0;
 }
 
 // ----------------- MAIN -----------------
@@ -2219,7 +6996,7 @@ void continuePrompt(){
 // This function refreshes the console
 // and displays a visual element
 void refreshConsole(){
-    system("cls");    // no remote access to this program so it should be safe enough
+    system(CLEAR_COMMAND);    // no remote access to this program so it should be safe enough
     cout << ANSI_COLOR_GREEN;
     cout << "+--------------------------+\n";
     cout << "|   Blockchain Simulator   |\n";
@@ -2229,6 +7006,13 @@ void refreshConsole(){
 }
 
 int main(int argc, char* argv[]){
+    // --headless scenario.txt [--out summary.json] runs a scenario without the menu
+    if (argc >= 3 && strcmp(argv[1], "--headless") == 0)
+        return runHeadless(argv[2], argc >= 5 && strcmp(argv[3], "--out") == 0 ? argv[4] : "");
+    // --bench [quick] runs the microbenchmarks
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+        return runBenchmarks(argc >= 3 && strcmp(argv[2], "quick") == 0);
+
     cout << fixed << setprecision(2);   // set cout fp precision
 
     Blockchain bc;   // our blockchain
@@ -2341,7 +7125,7 @@ int main(int argc, char* argv[]){
         slowPrint("In our case, along with the generation of this block, a wallet has been created for the \"God\" address.\n");
         slowPrint("This wallet contains 1000 coins:\n\n");
         cout << ANSI_COLOR_GREEN << "~=~=~=~=~=~=~=~=~=~=~= WALLET ~=~=~=~=~=~=~=~=~=~=~\n" << ANSI_COLOR_RESET;
-        cout << bc.getWallets().at(Transaction::getGodAddress()) << endl;
+        cout << bc.getWallet(Transaction::getGodAddress()) << endl;
         slowPrint("You can now start sending transactions and mining blocks. Press any key to continue.\n", normalMenuSpeed, true);
         continuePrompt();
         refreshConsole();
@@ -2390,9 +7174,9 @@ int main(int argc, char* argv[]){
             case '2':
                 // view the wallets
                 slowPrint("The wallets in the blockchain are:\n\n", fastMenuSpeed);
-                for (pair<string, Wallet> pair : bc.getWallets()){
+                for (int index = 0; index < bc.getAccounts().getSize(); index++){
                     cout << ANSI_COLOR_GREEN << " =-=-=-=-=-=-=-=-=-=- Wallet " << ++i << " -=-=-=-=-=-=-=-=-=-= \n" << ANSI_COLOR_RESET;
-                    cout << pair.second << endl;
+                    cout << bc.getWallet(bc.getAccounts().getAddress(index)) << endl;
                 }
                 break;
             case '3':
@@ -2453,7 +7237,7 @@ int main(int argc, char* argv[]){
                 } while (char_choice != 'Y' && char_choice != 'y' && char_choice != 'N' && char_choice != 'n');
 
                 if (char_choice == 'Y' || char_choice == 'y'){
-                    system("cls");
+                    system(CLEAR_COMMAND);
                     return 0;
                 }
                 